@@ -6,6 +6,7 @@
 // Implemented features:
 //  [X] Renderer: User texture binding. Use 'GLuint' OpenGL texture identifier as void*/ImTextureID. Read the FAQ about ImTextureID!
 //  [x] Renderer: Desktop GL only: Support for large meshes (64k+ vertices) with 16-bit indices.
+//  [x] Renderer: Desktop GL 3.2+ only: Vertex and index data streamed through persistent ring buffers, without per-frame reallocation.
 
 // You can copy and use unmodified imgui_impl_* files in your project. See main.cpp for an example of using this.
 // If you are new to dear imgui, read examples/README.txt and read the documentation at the top of imgui.cpp.
@@ -141,6 +142,10 @@ using namespace gl;
 #define IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET   1
 #endif
 
+// Streaming needs glDrawElementsBaseVertex() to draw each command list from its offset in the shared buffers, and fences.
+#define IMGUI_IMPL_OPENGL_MAY_STREAM            IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET
+#define IMGUI_IMPL_OPENGL_STREAM_REGIONS        3       // Frames that may be in flight on the GPU at once
+
 // OpenGL Data
 static GLuint       g_GlVersion = 0;                // Extracted at runtime using GL_MAJOR_VERSION, GL_MINOR_VERSION queries (e.g. 320 for GL 3.2)
 static char         g_GlslVersionString[32] = "";   // Specified by user or detected based on compile time GL settings.
@@ -149,6 +154,15 @@ static GLuint       g_ShaderHandle = 0, g_VertHandle = 0, g_FragHandle = 0;
 static int          g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;                                // Uniforms location
 static int          g_AttribLocationVtxPos = 0, g_AttribLocationVtxUV = 0, g_AttribLocationVtxColor = 0; // Vertex attributes location
 static unsigned int g_VboHandle = 0, g_ElementsHandle = 0;
+static ImGui_ImplOpenGL3_FrameStats g_FrameStats = {}, g_LastFrameStats = {};  // Accumulating, and completed by the last RenderDrawData()
+#if IMGUI_IMPL_OPENGL_MAY_STREAM
+// The VBO and IBO are each split into IMGUI_IMPL_OPENGL_STREAM_REGIONS regions, and each frame writes all of its
+// command lists into the next region. Storage is only reallocated when a frame outgrows it. Regions are mapped
+// unsynchronised, so a fence per region stops us overwriting data the GPU has yet to read.
+static int          g_StreamVtxCapacity = 0, g_StreamIdxCapacity = 0;           // Per region, in vertices and indices
+static int          g_StreamRegion = 0;
+static GLsync       g_StreamFences[IMGUI_IMPL_OPENGL_STREAM_REGIONS] = {};
+#endif
 
 // Functions
 bool    ImGui_ImplOpenGL3_Init(const char* glsl_version)
@@ -280,6 +294,65 @@ static void ImGui_ImplOpenGL3_SetupRenderState(ImDrawData* draw_data, int fb_wid
     glVertexAttribPointer(g_AttribLocationVtxColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof(ImDrawVert), (GLvoid*)IM_OFFSETOF(ImDrawVert, col));
 }
 
+#if IMGUI_IMPL_OPENGL_MAY_STREAM
+static void ImGui_ImplOpenGL3_StreamReleaseFences()
+{
+    for (int i = 0; i < IMGUI_IMPL_OPENGL_STREAM_REGIONS; i++)
+        if (g_StreamFences[i]) { glDeleteSync(g_StreamFences[i]); g_StreamFences[i] = 0; }
+}
+
+// Copy the vertices or indices of every command list into the current region of the bound buffer.
+static void ImGui_ImplOpenGL3_StreamWrite(ImDrawData* draw_data, GLenum target, size_t region_offset, size_t size, bool indices)
+{
+    void* mapped = glMapBufferRange(target, (GLintptr)region_offset, (GLsizeiptr)size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    size_t offset = 0;
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        const void* data = indices ? (const void*)cmd_list->IdxBuffer.Data : (const void*)cmd_list->VtxBuffer.Data;
+        size_t list_size = indices ? (size_t)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx) : (size_t)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
+        if (mapped)
+            memcpy((char*)mapped + offset, data, list_size);
+        else
+            glBufferSubData(target, (GLintptr)(region_offset + offset), (GLsizeiptr)list_size, data); // Mapping failed, copy through the driver instead
+        offset += list_size;
+    }
+    if (mapped)
+        glUnmapBuffer(target);
+}
+
+// Upload the whole frame into the next region, growing the buffers first if needed. The buffers must be bound.
+static void ImGui_ImplOpenGL3_StreamUpload(ImDrawData* draw_data)
+{
+    if (draw_data->TotalVtxCount > g_StreamVtxCapacity || draw_data->TotalIdxCount > g_StreamIdxCapacity)
+    {
+        // Grow with headroom, so that a slowly growing UI does not reallocate every frame.
+        // New storage orphans the old, which the driver keeps alive until the GPU is done with it, so no fences are needed.
+        int vtx_wanted = draw_data->TotalVtxCount + draw_data->TotalVtxCount / 2;
+        int idx_wanted = draw_data->TotalIdxCount + draw_data->TotalIdxCount / 2;
+        if (g_StreamVtxCapacity < vtx_wanted) g_StreamVtxCapacity = vtx_wanted > 4096 ? vtx_wanted : 4096;
+        if (g_StreamIdxCapacity < idx_wanted) g_StreamIdxCapacity = idx_wanted > 8192 ? idx_wanted : 8192;
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)g_StreamVtxCapacity * sizeof(ImDrawVert) * IMGUI_IMPL_OPENGL_STREAM_REGIONS, NULL, GL_STREAM_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)g_StreamIdxCapacity * sizeof(ImDrawIdx) * IMGUI_IMPL_OPENGL_STREAM_REGIONS, NULL, GL_STREAM_DRAW);
+        ImGui_ImplOpenGL3_StreamReleaseFences();
+    }
+
+    g_StreamRegion = (g_StreamRegion + 1) % IMGUI_IMPL_OPENGL_STREAM_REGIONS;
+    if (g_StreamFences[g_StreamRegion])
+    {
+        // Normally signalled long ago. Waiting is still better than corrupting a frame in flight.
+        glClientWaitSync(g_StreamFences[g_StreamRegion], GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)1000000000);
+        glDeleteSync(g_StreamFences[g_StreamRegion]);
+        g_StreamFences[g_StreamRegion] = 0;
+    }
+
+    if (draw_data->TotalVtxCount > 0)
+        ImGui_ImplOpenGL3_StreamWrite(draw_data, GL_ARRAY_BUFFER, (size_t)g_StreamRegion * g_StreamVtxCapacity * sizeof(ImDrawVert), (size_t)draw_data->TotalVtxCount * sizeof(ImDrawVert), false);
+    if (draw_data->TotalIdxCount > 0)
+        ImGui_ImplOpenGL3_StreamWrite(draw_data, GL_ELEMENT_ARRAY_BUFFER, (size_t)g_StreamRegion * g_StreamIdxCapacity * sizeof(ImDrawIdx), (size_t)draw_data->TotalIdxCount * sizeof(ImDrawIdx), true);
+}
+#endif
+
 // OpenGL3 Render function.
 // (this used to be set in io.RenderDrawListsFn and called by ImGui::Render(), but you can now call this directly from your main loop)
 // Note that this implementation is little overcomplicated because we are saving/setting up/restoring every OpenGL state explicitly, in order to be able to run within any OpenGL engine that doesn't do so.
@@ -338,14 +411,32 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
     ImVec2 clip_off = draw_data->DisplayPos;         // (0,0) unless using multi-viewports
     ImVec2 clip_scale = draw_data->FramebufferScale; // (1,1) unless using retina display which are often (2,2)
 
+    // Upload the whole frame at once when streaming, and draw each command list from its offset in the shared buffers
+    bool stream = false;
+    int list_vtx_offset = 0, list_idx_offset = 0;
+#if IMGUI_IMPL_OPENGL_MAY_STREAM
+    if (g_GlVersion >= 320)
+    {
+        stream = true;
+        ImGui_ImplOpenGL3_StreamUpload(draw_data);
+        list_vtx_offset = g_StreamRegion * g_StreamVtxCapacity;
+        list_idx_offset = g_StreamRegion * g_StreamIdxCapacity;
+    }
+#endif
+
     // Render command lists
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
 
         // Upload vertex/index buffers
-        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), (const GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), (const GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+        if (!stream)
+        {
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), (const GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), (const GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+        }
+        g_FrameStats.VertexBytes += (size_t)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
+        g_FrameStats.IndexBytes += (size_t)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
 
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
         {
@@ -380,20 +471,35 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
                     glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
 #if IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET
                     if (g_GlVersion >= 320)
-                        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx)), (GLint)pcmd->VtxOffset);
+                        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)((list_idx_offset + pcmd->IdxOffset) * sizeof(ImDrawIdx)), (GLint)(list_vtx_offset + pcmd->VtxOffset));
                     else
 #endif
                     glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx)));
+                    g_FrameStats.DrawCalls++;
                 }
             }
         }
+        if (stream)
+        {
+            list_vtx_offset += cmd_list->VtxBuffer.Size;
+            list_idx_offset += cmd_list->IdxBuffer.Size;
+        }
     }
 
+#if IMGUI_IMPL_OPENGL_MAY_STREAM
+    if (stream)
+        g_StreamFences[g_StreamRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+
     // Destroy the temporary VAO
 #ifndef IMGUI_IMPL_OPENGL_ES2
     glDeleteVertexArrays(1, &vertex_array_object);
 #endif
 
+    // Publish this frame's statistics
+    g_LastFrameStats = g_FrameStats;
+    g_FrameStats = ImGui_ImplOpenGL3_FrameStats();
+
     // Restore modified GL state
     glUseProgram(last_program);
     glBindTexture(GL_TEXTURE_2D, last_texture);
@@ -418,6 +524,11 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
     glScissor(last_scissor_box[0], last_scissor_box[1], (GLsizei)last_scissor_box[2], (GLsizei)last_scissor_box[3]);
 }
 
+const ImGui_ImplOpenGL3_FrameStats* ImGui_ImplOpenGL3_GetFrameStats()
+{
+    return &g_LastFrameStats;
+}
+
 bool ImGui_ImplOpenGL3_CreateFontsTexture()
 {
     // Build texture atlas
@@ -437,6 +548,7 @@ bool ImGui_ImplOpenGL3_CreateFontsTexture()
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 #endif
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    g_FrameStats.TextureBytes += (size_t)width * height * 4;
 
     // Store our identifier
     io.Fonts->TexID = (ImTextureID)(intptr_t)g_FontTexture;
@@ -678,6 +790,10 @@ void    ImGui_ImplOpenGL3_DestroyDeviceObjects()
 {
     if (g_VboHandle)        { glDeleteBuffers(1, &g_VboHandle); g_VboHandle = 0; }
     if (g_ElementsHandle)   { glDeleteBuffers(1, &g_ElementsHandle); g_ElementsHandle = 0; }
+#if IMGUI_IMPL_OPENGL_MAY_STREAM
+    ImGui_ImplOpenGL3_StreamReleaseFences();
+    g_StreamVtxCapacity = g_StreamIdxCapacity = 0;
+#endif
     if (g_ShaderHandle && g_VertHandle) { glDetachShader(g_ShaderHandle, g_VertHandle); }
     if (g_ShaderHandle && g_FragHandle) { glDetachShader(g_ShaderHandle, g_FragHandle); }
     if (g_VertHandle)       { glDeleteShader(g_VertHandle); g_VertHandle = 0; }
@@ -30,6 +30,17 @@ IMGUI_IMPL_API void     ImGui_ImplOpenGL3_Shutdown();
 IMGUI_IMPL_API void     ImGui_ImplOpenGL3_NewFrame();
 IMGUI_IMPL_API void     ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data);
 
+// (Optional) Data passed to the GL by the last call to ImGui_ImplOpenGL3_RenderDrawData(), for profiling.
+// Texture uploads made since the previous frame (e.g. rebuilding the font atlas) are included.
+struct ImGui_ImplOpenGL3_FrameStats
+{
+    size_t  VertexBytes;
+    size_t  IndexBytes;
+    size_t  TextureBytes;
+    int     DrawCalls;
+};
+IMGUI_IMPL_API const ImGui_ImplOpenGL3_FrameStats* ImGui_ImplOpenGL3_GetFrameStats();
+
 // (Optional) Called by Init/NewFrame/Shutdown
 IMGUI_IMPL_API bool     ImGui_ImplOpenGL3_CreateFontsTexture();
 IMGUI_IMPL_API void     ImGui_ImplOpenGL3_DestroyFontsTexture();
@@ -0,0 +1,292 @@
+/*
+ * Animation timeline.
+ *
+ * Each frame of an animation is a metasprite, whose patterns are streamed
+ * into a small buffer in VRAM as the animation plays. A tile that is still
+ * resident from the previous frame is reused where it is, so a transition
+ * only uploads the tiles the new frame adds. When a slot must be given up,
+ * the tile needed again furthest in the future is evicted.
+ *
+ * The uploads are those of the animation once it is looping. The buffer is
+ * filled with the tiles the loop starts from before the first frame is shown,
+ * and the uploads of each loop leave the buffer as they found it.
+ *
+ * In 8×16 mode the buffer is managed in pattern pairs.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "tile_store.h"
+#include "metasprite.h"
+#include "animation.h"
+
+#define ANIMATION_NOT_RESIDENT 0xffff
+#define ANIMATION_PASSES_MAX   8   /* Loops to wait for the buffer contents to repeat */
+
+
+/*
+ * List the distinct patterns (or pattern pairs) used by a frame.
+ */
+static std::vector<uint16_t> frame_patterns (const Animation_Frame *frame)
+{
+    std::vector<uint16_t> patterns;
+
+    for (const Metasprite_Entry &entry : frame->sprite.entries)
+    {
+        uint16_t pattern = frame->sprite.tall ? (entry.pattern & ~1u) : entry.pattern;
+
+        if (std::find (patterns.begin (), patterns.end (), pattern) == patterns.end ())
+        {
+            patterns.push_back (pattern);
+        }
+    }
+
+    return patterns;
+}
+
+
+/*
+ * Number of frames until a pattern is next used after frame, looping around.
+ */
+static uint32_t next_use (const std::vector<std::vector<uint16_t>> &patterns, uint32_t frame, uint16_t pattern)
+{
+    uint32_t count = patterns.size ();
+
+    for (uint32_t distance = 1; distance <= count; distance++)
+    {
+        const std::vector<uint16_t> &used = patterns [(frame + distance) % count];
+
+        if (std::find (used.begin (), used.end (), pattern) != used.end ())
+        {
+            return distance;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+
+/*
+ * Go around the loop once from the given buffer contents, recording each frame's uploads.
+ */
+static void animation_pass (Animation *animation, const std::vector<std::vector<uint16_t>> &patterns,
+                            uint32_t unit, std::vector<uint16_t> &resident)
+{
+    uint32_t count = animation->frames.size ();
+    uint32_t units = resident.size ();
+
+    for (uint32_t f = 0; f < count; f++)
+    {
+        const std::vector<uint16_t> &needed = patterns [f];
+        Animation_Delta *delta = &animation->deltas [f];
+        uint32_t bytes = 0;
+
+        delta->uploads.clear ();
+
+        for (uint16_t pattern : needed)
+        {
+            if (std::find (resident.begin (), resident.end (), pattern) != resident.end ())
+            {
+                continue;
+            }
+
+            /* Evict whichever unneeded tile will be wanted again last */
+            uint32_t victim = units;
+            uint32_t victim_distance = 0;
+
+            for (uint32_t u = 0; u < units; u++)
+            {
+                uint32_t distance = UINT32_MAX;
+
+                if (resident [u] != ANIMATION_NOT_RESIDENT)
+                {
+                    if (std::find (needed.begin (), needed.end (), resident [u]) != needed.end ())
+                    {
+                        continue;
+                    }
+                    distance = next_use (patterns, f, resident [u]);
+                }
+
+                if (victim == units || distance > victim_distance)
+                {
+                    victim = u;
+                    victim_distance = distance;
+                }
+            }
+
+            resident [victim] = pattern;
+
+            for (uint32_t i = 0; i < unit; i++)
+            {
+                Animation_Upload upload = { (uint16_t) (victim * unit + i), (uint16_t) (pattern + i) };
+                delta->uploads.push_back (upload);
+            }
+            bytes += unit * 32;
+        }
+
+        delta->bytes = bytes;
+
+        /* Point each sprite at the slot holding its pattern */
+        delta->entry_slot.clear ();
+        for (const Metasprite_Entry &entry : animation->frames [f].sprite.entries)
+        {
+            uint16_t pattern = animation->tall ? (entry.pattern & ~1u) : entry.pattern;
+            uint32_t u = std::find (resident.begin (), resident.end (), pattern) - resident.begin ();
+            delta->entry_slot.push_back (u * unit);
+        }
+    }
+}
+
+
+/*
+ * Assign each frame's tiles to slots in a streaming buffer.
+ */
+void animation_stream (Animation *animation)
+{
+    uint32_t count = animation->frames.size ();
+    std::vector<std::vector<uint16_t>> patterns (count);
+    uint32_t unit = 1;
+
+    animation->tall = count > 0 && animation->frames [0].sprite.tall;
+    animation->buffer_slots = 0;
+    animation->initial_bytes = 0;
+    animation->initial_uploads.clear ();
+    animation->deltas.assign (count, Animation_Delta ());
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (animation->tall)
+    {
+        unit = 2;
+    }
+
+    /* The buffer holds the largest frame */
+    uint32_t units = 0;
+    for (uint32_t f = 0; f < count; f++)
+    {
+        patterns [f] = frame_patterns (&animation->frames [f]);
+        units = std::max (units, (uint32_t) patterns [f].size ());
+    }
+    animation->buffer_slots = units * unit;
+
+    /* Fill the buffer from empty, then go around the loop until the buffer
+     * holds the same tiles at the end of a loop as at its start, so that the
+     * recorded uploads can be repeated for as long as the animation plays. */
+    std::vector<uint16_t> resident (units, ANIMATION_NOT_RESIDENT);
+    std::vector<uint16_t> start;
+
+    animation_pass (animation, patterns, unit, resident);
+    for (uint32_t pass = 0; pass < ANIMATION_PASSES_MAX; pass++)
+    {
+        start = resident;
+        animation_pass (animation, patterns, unit, resident);
+
+        if (resident == start)
+        {
+            break;
+        }
+    }
+
+    /* Otherwise, the first frame also puts back the tiles the loop started
+     * with, other than in the slots that its own uploads overwrite */
+    Animation_Delta *first = &animation->deltas [0];
+    std::vector<Animation_Upload> restore;
+
+    for (uint32_t u = 0; u < units; u++)
+    {
+        bool overwritten = false;
+        for (const Animation_Upload &upload : first->uploads)
+        {
+            overwritten |= upload.slot == u * unit;
+        }
+
+        if (resident [u] != start [u] && start [u] != ANIMATION_NOT_RESIDENT && !overwritten)
+        {
+            for (uint32_t i = 0; i < unit; i++)
+            {
+                Animation_Upload upload = { (uint16_t) (u * unit + i), (uint16_t) (start [u] + i) };
+                restore.push_back (upload);
+            }
+            first->bytes += unit * 32;
+        }
+    }
+    first->uploads.insert (first->uploads.begin (), restore.begin (), restore.end ());
+
+    /* Before the first frame is first shown, the buffer is filled with the tiles the loop starts with */
+    for (uint32_t u = 0; u < units; u++)
+    {
+        if (start [u] != ANIMATION_NOT_RESIDENT)
+        {
+            for (uint32_t i = 0; i < unit; i++)
+            {
+                Animation_Upload upload = { (uint16_t) (u * unit + i), (uint16_t) (start [u] + i) };
+                animation->initial_uploads.push_back (upload);
+            }
+            animation->initial_bytes += unit * 32;
+        }
+    }
+}
+
+
+/*
+ * Export the per-frame upload lists and sprite pattern tables to stdout.
+ */
+void animation_export (const Animation *animation, const char *label)
+{
+    uint32_t count = animation->frames.size ();
+
+    printf ("/* %u frames, %u pattern streaming buffer, %u bytes before the first frame */\n",
+            count, animation->buffer_slots, animation->initial_bytes);
+
+    /* Pairs of buffer slot and tileset pattern, to upload once before the first frame */
+    printf ("const uint16_t %s_initial_uploads [] = { %u", label, (uint32_t) animation->initial_uploads.size ());
+    for (const Animation_Upload &upload : animation->initial_uploads)
+    {
+        printf (", %u, %u", upload.slot, upload.pattern);
+    }
+    printf (" };\n");
+
+    for (uint32_t f = 0; f < count; f++)
+    {
+        const Animation_Frame *frame = &animation->frames [f];
+        const Animation_Delta *delta = &animation->deltas [f];
+
+        printf ("/* Frame %u: %u video frames, %u bytes to upload */\n", f, frame->duration, delta->bytes);
+
+        /* Pairs of buffer slot and tileset pattern */
+        printf ("const uint16_t %s_%u_uploads [] = { %u", label, f, (uint32_t) delta->uploads.size ());
+        for (const Animation_Upload &upload : delta->uploads)
+        {
+            printf (", %u, %u", upload.slot, upload.pattern);
+        }
+        printf (" };\n");
+
+        printf ("const int8_t %s_%u_y [] = {", label, f);
+        for (uint32_t i = 0; i < frame->sprite.entries.size (); i++)
+        {
+            printf (i ? ", %d" : " %d", frame->sprite.entries [i].y);
+        }
+        printf (" };\n");
+
+        printf ("const int8_t %s_%u_x [] = {", label, f);
+        for (uint32_t i = 0; i < frame->sprite.entries.size (); i++)
+        {
+            printf (i ? ", %d" : " %d", frame->sprite.entries [i].x);
+        }
+        printf (" };\n");
+
+        /* Pattern numbers are relative to the start of the streaming buffer */
+        printf ("const uint8_t %s_%u_pattern [] = {", label, f);
+        for (uint32_t i = 0; i < delta->entry_slot.size (); i++)
+        {
+            printf (i ? ", %u" : " %u", delta->entry_slot [i]);
+        }
+        printf (" };\n");
+    }
+}
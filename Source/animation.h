@@ -0,0 +1,43 @@
+#pragma once
+/*
+ * Animation timeline API.
+ */
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "metasprite.h"
+
+typedef struct Animation_Frame_s {
+    Metasprite sprite;
+    uint32_t duration;      /* In video frames */
+} Animation_Frame;
+
+typedef struct Animation_Upload_s {
+    uint16_t slot;          /* Pattern offset within the streaming buffer */
+    uint16_t pattern;       /* Tile store index */
+} Animation_Upload;
+
+typedef struct Animation_Delta_s {
+    std::vector<Animation_Upload> uploads;  /* Tiles to write before this frame is shown */
+    std::vector<uint16_t> entry_slot;       /* Buffer slot used by each sprite entry */
+    uint32_t bytes;
+} Animation_Delta;
+
+typedef struct Animation_s {
+    std::vector<Animation_Frame> frames;
+
+    /* Set by animation_stream () */
+    bool tall;
+    uint32_t buffer_slots;                  /* Patterns reserved in VRAM for the animation */
+    std::vector<Animation_Upload> initial_uploads;  /* Fill the buffer before the first frame is first shown */
+    uint32_t initial_bytes;
+    std::vector<Animation_Delta> deltas;    /* Upload into each frame, repeated on every loop */
+} Animation;
+
+/* Assign each frame's tiles to slots in a streaming buffer, uploading as few tiles as possible per transition. */
+void animation_stream (Animation *animation);
+
+/* Export the per-frame upload lists and sprite pattern tables to stdout. */
+void animation_export (const Animation *animation, const char *label);
@@ -0,0 +1,493 @@
+/*
+ * Micro-benchmarks for the encoding and conversion kernels.
+ *
+ * Each kernel is run over a corpus of tiles: a fixed pseudo-random corpus,
+ * a synthetic corpus with the flat areas and gradients of typical artwork,
+ * and optionally tiles cut from PPM images given on the command line.
+ * After a few warm-up runs, each kernel is timed over several repetitions
+ * and the per-tile times are summarised.
+ *
+ * Usage: snepsprite_benchmark [--json] [--repetitions N] [--corpus image.ppm]...
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "colour.h"
+#include "dither.h"
+#include "jobs.h"
+#include "ppm.h"
+#include "tile_store.h"
+
+#define BENCHMARK_TILES     4096
+#define BENCHMARK_WARMUP    3
+
+typedef struct Corpus_s {
+    std::string name;
+    std::vector<uint8_t> rgb;       /* 8×8 tiles of 24-bit colour, 192 bytes each */
+    std::vector<Tile> tiles;        /* The same tiles quantised to the palette */
+} Corpus;
+
+typedef struct Result_s {
+    std::string kernel;
+    std::string corpus;
+    uint32_t items;
+    double bytes_per_item;          /* Input consumed per item, for MB/s */
+    double median;                  /* Nanoseconds per item */
+    double min;
+    double mean;
+    double stddev;
+} Result;
+
+/* Default editor palette */
+static const uint8_t palette [16] = { 0x30, 0x3f, 0x37, 0x3b, 0x0f, 0x0b, 0x00, 0x2f,
+                                      0x06, 0x0b, 0x01, 0x3e, 0x38, 0x0c, 0x08, 0x3c };
+
+static uint32_t repetitions = 20;
+static std::vector<uint8_t> lut (32768);
+static std::vector<Result> results;
+
+/* Kernel outputs are folded into this, so that the work cannot be optimised away */
+static volatile uint64_t sink;
+
+
+/*
+ * Fixed pseudo-random sequence (xorshift32).
+ */
+static uint32_t random_next (uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+/*
+ * Quantise the RGB tiles of a corpus to palette indices.
+ */
+static void corpus_quantise (Corpus *corpus)
+{
+    uint32_t count = corpus->rgb.size () / 192;
+
+    corpus->tiles.resize (count);
+
+    for (uint32_t t = 0; t < count; t++)
+    {
+        const uint8_t *rgb = &corpus->rgb [t * 192];
+
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            corpus->tiles [t].pixel [i] = lut [RGB15 (rgb [i * 3], rgb [i * 3 + 1], rgb [i * 3 + 2])];
+        }
+        tile_encode_planar (corpus->tiles [t].pixel, corpus->tiles [t].planar);
+    }
+}
+
+
+/*
+ * Uncorrelated noise: the worst case for deduplication.
+ */
+static void corpus_random (Corpus *corpus)
+{
+    uint32_t state = 0x12345678;
+
+    corpus->name = "random";
+    corpus->rgb.resize (BENCHMARK_TILES * 192);
+
+    for (uint8_t &value : corpus->rgb)
+    {
+        value = random_next (&state) >> 24;
+    }
+
+    corpus_quantise (corpus);
+}
+
+
+/*
+ * Flat areas, gradients and outlines, with many repeated tiles.
+ */
+static void corpus_synthetic (Corpus *corpus)
+{
+    uint32_t state = 0x9e3779b9;
+    uint32_t width = 512;
+    uint32_t height = BENCHMARK_TILES * 64 / width;
+    std::vector<uint8_t> image ((size_t) width * height * 3);
+
+    corpus->name = "synthetic";
+
+    /* Sky gradient */
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint8_t *p = &image [(x + y * width) * 3];
+            p [0] = 32 + y * 96 / height;
+            p [1] = 64 + y * 128 / height;
+            p [2] = 255 - y * 64 / height;
+        }
+    }
+
+    /* Filled, outlined boxes */
+    for (uint32_t i = 0; i < 96; i++)
+    {
+        uint32_t box_x = random_next (&state) % width;
+        uint32_t box_y = random_next (&state) % height;
+        uint32_t box_w = 8 + random_next (&state) % 96;
+        uint32_t box_h = 8 + random_next (&state) % 96;
+        uint8_t colour [3] = { (uint8_t) (random_next (&state) >> 24), (uint8_t) (random_next (&state) >> 24),
+                               (uint8_t) (random_next (&state) >> 24) };
+
+        for (uint32_t y = box_y; y < std::min (height, box_y + box_h); y++)
+        {
+            for (uint32_t x = box_x; x < std::min (width, box_x + box_w); x++)
+            {
+                bool edge = x == box_x || y == box_y || x == box_x + box_w - 1 || y == box_y + box_h - 1;
+                uint8_t *p = &image [(x + y * width) * 3];
+                p [0] = edge ? 0 : colour [0];
+                p [1] = edge ? 0 : colour [1];
+                p [2] = edge ? 0 : colour [2];
+            }
+        }
+    }
+
+    /* Slice into tiles */
+    corpus->rgb.resize (BENCHMARK_TILES * 192);
+    for (uint32_t t = 0; t < BENCHMARK_TILES; t++)
+    {
+        uint32_t tile_x = (t % (width / 8)) * 8;
+        uint32_t tile_y = (t / (width / 8)) * 8;
+
+        for (uint32_t y = 0; y < 8; y++)
+        {
+            memcpy (&corpus->rgb [t * 192 + y * 24], &image [(tile_x + (tile_y + y) * width) * 3], 24);
+        }
+    }
+
+    corpus_quantise (corpus);
+}
+
+
+/*
+ * Tiles cut from a PPM image. Partial tiles at the edges are skipped.
+ */
+static bool corpus_load (Corpus *corpus, const char *path)
+{
+    uint32_t width;
+    uint32_t height;
+    std::string error;
+
+    FILE *file = ppm_open (path, &width, &height, &error);
+    if (file == NULL)
+    {
+        fprintf (stderr, "Error: %s: %s\n", path, error.c_str ());
+        return false;
+    }
+
+    std::vector<uint8_t> image ((size_t) width * height * 3);
+    if (fread (image.data (), 1, image.size (), file) != image.size ())
+    {
+        fprintf (stderr, "Error: %s: Image data is truncated\n", path);
+        fclose (file);
+        return false;
+    }
+    fclose (file);
+
+    corpus->name = path;
+    corpus->rgb.clear ();
+
+    for (uint32_t tile_y = 0; tile_y + 8 <= height; tile_y += 8)
+    {
+        for (uint32_t tile_x = 0; tile_x + 8 <= width; tile_x += 8)
+        {
+            for (uint32_t y = 0; y < 8; y++)
+            {
+                const uint8_t *row = &image [(tile_x + (tile_y + y) * width) * 3];
+                corpus->rgb.insert (corpus->rgb.end (), row, row + 24);
+            }
+        }
+    }
+
+    if (corpus->rgb.empty ())
+    {
+        fprintf (stderr, "Error: %s: Image is smaller than one tile\n", path);
+        return false;
+    }
+
+    corpus_quantise (corpus);
+    return true;
+}
+
+
+/*
+ * Time a kernel over a corpus and record the result.
+ * The kernel processes every item of the corpus once per call.
+ */
+static void benchmark_run (const char *kernel, const Corpus *corpus, uint32_t items, double bytes_per_item,
+                           uint64_t (*fn) (const Corpus *corpus))
+{
+    std::vector<double> samples;
+
+    for (uint32_t i = 0; i < BENCHMARK_WARMUP; i++)
+    {
+        sink += fn (corpus);
+    }
+
+    for (uint32_t i = 0; i < repetitions; i++)
+    {
+        auto start = std::chrono::steady_clock::now ();
+        sink += fn (corpus);
+        auto end = std::chrono::steady_clock::now ();
+
+        samples.push_back (std::chrono::duration<double, std::nano> (end - start).count () / items);
+    }
+
+    std::sort (samples.begin (), samples.end ());
+
+    Result result;
+    result.kernel = kernel;
+    result.corpus = corpus->name;
+    result.items = items;
+    result.bytes_per_item = bytes_per_item;
+    result.median = samples [samples.size () / 2];
+    result.min = samples [0];
+    result.mean = 0.0;
+    result.stddev = 0.0;
+
+    for (double sample : samples)
+    {
+        result.mean += sample / samples.size ();
+    }
+    for (double sample : samples)
+    {
+        result.stddev += (sample - result.mean) * (sample - result.mean) / samples.size ();
+    }
+    result.stddev = sqrt (result.stddev);
+
+    results.push_back (result);
+}
+
+
+/*
+ * Kernels.
+ */
+static uint64_t kernel_planar_encode (const Corpus *corpus)
+{
+    uint64_t checksum = 0;
+    uint8_t planar [32];
+
+    for (const Tile &tile : corpus->tiles)
+    {
+        tile_encode_planar (tile.pixel, planar);
+        checksum += planar [0] + planar [31];
+    }
+
+    return checksum;
+}
+
+static uint64_t kernel_quantise (const Corpus *corpus)
+{
+    uint64_t checksum = 0;
+    const uint8_t *rgb = corpus->rgb.data ();
+
+    for (size_t i = 0; i < corpus->rgb.size (); i += 3)
+    {
+        checksum += lut [RGB15 (rgb [i], rgb [i + 1], rgb [i + 2])];
+    }
+
+    return checksum;
+}
+
+static uint64_t kernel_dither (const Corpus *corpus)
+{
+    /* Treat the corpus as a single column of tiles */
+    uint32_t rows = corpus->rgb.size () / 24;
+    std::vector<uint8_t> indexed ((size_t) rows * 8);
+    Dither_State state;
+
+    dither_init (&state, DITHER_FLOYD_STEINBERG, 8, palette, lut.data ());
+    dither_rows (&state, corpus->rgb.data (), 0, rows, indexed.data ());
+
+    return indexed [0] + indexed.back ();
+}
+
+static uint64_t kernel_hash (const Corpus *corpus)
+{
+    uint64_t checksum = 0;
+
+    for (const Tile &tile : corpus->tiles)
+    {
+        checksum ^= tile_hash (tile.pixel);
+    }
+
+    return checksum;
+}
+
+static uint64_t kernel_dedup (const Corpus *corpus)
+{
+    Tile_Store store;
+
+    for (const Tile &tile : corpus->tiles)
+    {
+        tile_store_add (&store, &tile, tile_hash (tile.pixel));
+    }
+
+    return store.tiles.size ();
+}
+
+static uint64_t kernel_lut_build (const Corpus * /* corpus */)
+{
+    quantise_lut_build (palette, lut.data (), false);
+    return lut [0];
+}
+
+static uint64_t kernel_colour_rgb (const Corpus * /* corpus */)
+{
+    uint64_t checksum = 0;
+    uint8_t rgb [3];
+
+    for (uint32_t colour = 0; colour < 64; colour++)
+    {
+        sms_colour_rgb (colour, rgb);
+        checksum += rgb [0] + rgb [1] + rgb [2];
+    }
+
+    return checksum;
+}
+
+
+/*
+ * Print the results as a table.
+ */
+static void results_print (void)
+{
+    printf ("%-16s %-12s %8s %10s %10s %10s %10s %10s\n",
+            "kernel", "corpus", "items", "median ns", "min ns", "mean ns", "stddev", "MB/s");
+
+    for (const Result &result : results)
+    {
+        printf ("%-16s %-12s %8u %10.2f %10.2f %10.2f %10.2f %10.1f\n",
+                result.kernel.c_str (), result.corpus.c_str (), result.items, result.median,
+                result.min, result.mean, result.stddev, result.bytes_per_item * 1000.0 / result.median);
+    }
+}
+
+
+/*
+ * Print a string as a JSON string literal.
+ */
+static void json_string (const std::string &string)
+{
+    putchar ('"');
+    for (char c : string)
+    {
+        if (c == '"' || c == '\\')
+        {
+            putchar ('\\');
+        }
+        putchar (c);
+    }
+    putchar ('"');
+}
+
+
+/*
+ * Print the results as JSON, for tracking across commits.
+ */
+static void results_print_json (void)
+{
+    printf ("{\n  \"repetitions\": %u,\n  \"results\": [\n", repetitions);
+
+    for (uint32_t i = 0; i < results.size (); i++)
+    {
+        const Result &result = results [i];
+
+        printf ("    { \"kernel\": ");
+        json_string (result.kernel);
+        printf (", \"corpus\": ");
+        json_string (result.corpus);
+        printf (", \"items\": %u, \"ns_median\": %.3f, \"ns_min\": %.3f, \"ns_mean\": %.3f, "
+                "\"ns_stddev\": %.3f, \"mb_per_s\": %.2f }%s\n",
+                result.items, result.median, result.min, result.mean, result.stddev,
+                result.bytes_per_item * 1000.0 / result.median, (i + 1 < results.size ()) ? "," : "");
+    }
+
+    printf ("  ]\n}\n");
+}
+
+
+int main (int argc, char **argv)
+{
+    bool json = false;
+    std::vector<Corpus> corpora (2);
+
+    quantise_lut_build (palette, lut.data (), false);
+    corpus_random (&corpora [0]);
+    corpus_synthetic (&corpora [1]);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp (argv [i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (strcmp (argv [i], "--repetitions") == 0 && i + 1 < argc)
+        {
+            repetitions = std::max (1, atoi (argv [++i]));
+        }
+        else if (strcmp (argv [i], "--corpus") == 0 && i + 1 < argc)
+        {
+            Corpus corpus;
+            if (!corpus_load (&corpus, argv [++i]))
+            {
+                return EXIT_FAILURE;
+            }
+            corpora.push_back (corpus);
+        }
+        else
+        {
+            fprintf (stderr, "Usage: %s [--json] [--repetitions N] [--corpus image.ppm]...\n", argv [0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    jobs_init (0);
+
+    for (const Corpus &corpus : corpora)
+    {
+        uint32_t tiles = corpus.tiles.size ();
+
+        benchmark_run ("planar_encode", &corpus, tiles, 64, kernel_planar_encode);
+        benchmark_run ("quantise", &corpus, tiles, 192, kernel_quantise);
+        benchmark_run ("dither_fs", &corpus, tiles, 192, kernel_dither);
+        benchmark_run ("hash", &corpus, tiles, 64, kernel_hash);
+        benchmark_run ("dedup", &corpus, tiles, 64, kernel_dedup);
+    }
+
+    /* Corpus-independent kernels, per call */
+    benchmark_run ("lut_build", &corpora [0], 1, sizeof (uint8_t) * 32768, kernel_lut_build);
+    benchmark_run ("colour_rgb", &corpora [0], 64, 1, kernel_colour_rgb);
+
+    jobs_shutdown ();
+
+    if (json)
+    {
+        results_print_json ();
+    }
+    else
+    {
+        results_print ();
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+ * Colour conversion.
+ *
+ * Colour matching is done in CIE L*a*b*, so that the error between a source
+ * colour and an SMS colour follows what the eye sees rather than raw RGB.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "colour.h"
+
+
+/*
+ * Convert a 6-bit SMS colour into 8-bit RGB.
+ */
+void sms_colour_rgb (uint8_t colour, uint8_t *rgb)
+{
+    rgb [0] = (0xff / 3) * ((colour & 0x03) >> 0);
+    rgb [1] = (0xff / 3) * ((colour & 0x0c) >> 2);
+    rgb [2] = (0xff / 3) * ((colour & 0x30) >> 4);
+}
+
+
+/*
+ * Convert 8-bit sRGB into CIE L*a*b* (D65 white point).
+ */
+static void rgb_to_lab (uint8_t r8, uint8_t g8, uint8_t b8, float *lab)
+{
+    float rgb [3] = { r8 / 255.0f, g8 / 255.0f, b8 / 255.0f };
+    float xyz [3];
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        rgb [i] = (rgb [i] <= 0.04045f) ? rgb [i] / 12.92f : powf ((rgb [i] + 0.055f) / 1.055f, 2.4f);
+    }
+
+    xyz [0] = (0.4124f * rgb [0] + 0.3576f * rgb [1] + 0.1805f * rgb [2]) / 0.95047f;
+    xyz [1] = (0.2126f * rgb [0] + 0.7152f * rgb [1] + 0.0722f * rgb [2]);
+    xyz [2] = (0.0193f * rgb [0] + 0.1192f * rgb [1] + 0.9505f * rgb [2]) / 1.08883f;
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        xyz [i] = (xyz [i] > 0.008856f) ? cbrtf (xyz [i]) : (7.787f * xyz [i] + 16.0f / 116.0f);
+    }
+
+    lab [0] = 116.0f * xyz [1] - 16.0f;
+    lab [1] = 500.0f * (xyz [0] - xyz [1]);
+    lab [2] = 200.0f * (xyz [1] - xyz [2]);
+}
+
+
+/*
+ * CIE L*a*b* coordinates of each 15-bit RGB value, three floats per entry.
+ */
+const float *colour_rgb15_lab (void)
+{
+    /* Initialised once, on first use, from whichever thread gets here first */
+    static const std::vector<float> table = [] {
+        std::vector<float> table (32768 * 3);
+
+        for (uint32_t rgb15 = 0; rgb15 < 32768; rgb15++)
+        {
+            rgb_to_lab (((rgb15 >> 10) & 0x1f) * 255 / 31,
+                        ((rgb15 >>  5) & 0x1f) * 255 / 31,
+                        ((rgb15 >>  0) & 0x1f) * 255 / 31, &table [rgb15 * 3]);
+        }
+
+        return table;
+    } ();
+
+    return table.data ();
+}
+
+
+/*
+ * CIE L*a*b* coordinates of each of the 64 SMS colours, three floats per entry.
+ */
+const float *colour_sms_lab (void)
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> table (64 * 3);
+        uint8_t rgb [3];
+
+        for (uint32_t colour = 0; colour < 64; colour++)
+        {
+            sms_colour_rgb (colour, rgb);
+            rgb_to_lab (rgb [0], rgb [1], rgb [2], &table [colour * 3]);
+        }
+
+        return table;
+    } ();
+
+    return table.data ();
+}
+
+
+/*
+ * Build a lookup table from 15-bit RGB to the nearest palette index.
+ */
+void quantise_lut_build (const uint8_t *palette, uint8_t *lut, bool transparent)
+{
+    const float *rgb15_lab = colour_rgb15_lab ();
+    const float *sms_lab = colour_sms_lab ();
+
+    for (uint32_t rgb15 = 0; rgb15 < 32768; rgb15++)
+    {
+        float best_distance = INFINITY;
+
+        for (uint32_t i = transparent ? 1 : 0; i < 16; i++)
+        {
+            float distance = colour_distance (&rgb15_lab [rgb15 * 3], &sms_lab [(palette [i] & 0x3f) * 3]);
+
+            /* Ties go to the lowest index */
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                lut [rgb15] = i;
+            }
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+/*
+ * Colour conversion API.
+ */
+
+#include <stdint.h>
+
+/* Convert a 6-bit SMS colour into 8-bit RGB. */
+void sms_colour_rgb (uint8_t colour, uint8_t *rgb);
+
+/* Reduce 8-bit RGB to the 15-bit form used for histograms and lookup tables. */
+#define RGB15(R, G, B) ((((R) >> 3) << 10) | (((G) >> 3) << 5) | ((B) >> 3))
+
+/* CIE L*a*b* coordinates of each 15-bit RGB value, and of each of the 64 SMS colours. */
+const float *colour_rgb15_lab (void);
+const float *colour_sms_lab (void);
+
+/* Squared perceptual distance between two L*a*b* colours. */
+static inline float colour_distance (const float *a, const float *b)
+{
+    float dl = a [0] - b [0];
+    float da = a [1] - b [1];
+    float db = a [2] - b [2];
+
+    return dl * dl + da * da + db * db;
+}
+
+/* Build a lookup table from 15-bit RGB to the nearest palette index.
+ * If transparent is set, index 0 is left out, as no pixel should take it. */
+void quantise_lut_build (const uint8_t *palette, uint8_t *lut, bool transparent);
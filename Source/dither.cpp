@@ -0,0 +1,281 @@
+/*
+ * Dithering.
+ *
+ * Quantises rows of truecolour pixels to palette indices, optionally with
+ * Bayer ordered dithering or Floyd–Steinberg / Atkinson error diffusion.
+ *
+ * Error diffusion is written in "pull" form: each pixel sums the stored
+ * errors of its already-quantised neighbours in a fixed order, using integer
+ * arithmetic. Rows are handed out in order and each row trails the row above
+ * it by a few pixels (a wavefront), so several threads can work on a group of
+ * rows at once while producing exactly the same output as a single thread.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "colour.h"
+#include "jobs.h"
+#include "trace.h"
+#include "dither.h"
+
+/* Ordered dithering offsets span ±DITHER_ORDERED_SPREAD / 2 */
+#define DITHER_ORDERED_SPREAD 64
+
+/* Pixels processed between wavefront progress updates */
+#define DITHER_CHUNK 16
+
+/* Rows of carried error kept between calls */
+#define DITHER_CARRY_ROWS 2
+
+const char *dither_mode_names [DITHER_MODE_COUNT] = {
+    "None",
+    "Ordered (Bayer 8×8)",
+    "Floyd–Steinberg",
+    "Atkinson"
+};
+
+static const uint8_t bayer_8x8 [8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+
+/*
+ * Prepare to quantise an image of the given width.
+ */
+void dither_init (Dither_State *state, Dither_Mode mode, uint32_t width, const uint8_t *palette, const uint8_t *lut)
+{
+    state->mode = mode;
+    state->width = width;
+    state->lut = lut;
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        sms_colour_rgb (palette [i], state->palette_rgb [i]);
+    }
+
+    state->error.assign (0, 0);
+}
+
+
+/*
+ * Quantise one row without dithering.
+ */
+static void dither_row_none (Dither_State *state, uint32_t row)
+{
+    const uint8_t *rgb = &state->rgb [(size_t) row * state->width * 3];
+    uint8_t *indexed = &state->indexed [(size_t) row * state->width];
+
+    for (uint32_t x = 0; x < state->width; x++)
+    {
+        indexed [x] = state->lut [RGB15 (rgb [x * 3 + 0], rgb [x * 3 + 1], rgb [x * 3 + 2])];
+    }
+}
+
+
+/*
+ * Quantise one row with Bayer ordered dithering.
+ *
+ * The threshold offsets are applied as a separate pass over a buffer of
+ * channel values so that the add-and-clamp loop vectorises.
+ */
+static void dither_row_ordered (Dither_State *state, uint32_t row)
+{
+    const uint8_t *rgb = &state->rgb [(size_t) row * state->width * 3];
+    uint8_t *indexed = &state->indexed [(size_t) row * state->width];
+    const uint8_t *bayer_row = bayer_8x8 [(state->y + row) & 7];
+    int16_t offset [8 * 3];
+    uint8_t adjusted [DITHER_CHUNK * 3];
+
+    for (uint32_t i = 0; i < 8 * 3; i++)
+    {
+        offset [i] = ((bayer_row [i / 3] * 2 - 63) * DITHER_ORDERED_SPREAD) / 128;
+    }
+
+    for (uint32_t x = 0; x < state->width; x += DITHER_CHUNK)
+    {
+        uint32_t count = std::min (state->width - x, (uint32_t) DITHER_CHUNK);
+
+        /* DITHER_CHUNK is a multiple of 8, so the offset pattern starts at 0 for each chunk */
+        for (uint32_t i = 0; i < count * 3; i++)
+        {
+            int16_t value = rgb [x * 3 + i] + offset [i % (8 * 3)];
+            adjusted [i] = std::min ((int16_t) 255, std::max ((int16_t) 0, value));
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            indexed [x + i] = state->lut [RGB15 (adjusted [i * 3 + 0], adjusted [i * 3 + 1], adjusted [i * 3 + 2])];
+        }
+    }
+}
+
+
+/*
+ * Wait until the row above (buffer row r - 1) has finished up to column x.
+ */
+static void dither_wait (Dither_State *state, uint32_t r, uint32_t x)
+{
+    if (r <= DITHER_CARRY_ROWS)
+    {
+        return; /* Carried rows are already complete */
+    }
+
+    while (state->progress [r - 1].load (std::memory_order_acquire) < x)
+    {
+        std::this_thread::yield ();
+    }
+}
+
+
+/*
+ * Quantise one row with error diffusion.
+ */
+static void dither_row_diffuse (Dither_State *state, uint32_t row)
+{
+    const uint8_t *rgb = &state->rgb [(size_t) row * state->width * 3];
+    uint8_t *indexed = &state->indexed [(size_t) row * state->width];
+    uint32_t width = state->width;
+
+    /* Error buffer rows: r is this row, r - 1 and r - 2 are the two above */
+    uint32_t r = row + DITHER_CARRY_ROWS;
+    int16_t *e0 = &state->error [(size_t) r * width * 3];
+    const int16_t *e1 = e0 - width * 3;
+    const int16_t *e2 = e1 - width * 3;
+    bool atkinson = (state->mode == DITHER_ATKINSON);
+
+    for (uint32_t x = 0; x < width; x++)
+    {
+        /* The pixels above-right must be done before this one */
+        if (x % DITHER_CHUNK == 0)
+        {
+            dither_wait (state, r, std::min (width, x + DITHER_CHUNK + 1));
+        }
+
+        uint8_t target [3];
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            int32_t left  = (x >= 1) ? e0 [(x - 1) * 3 + c] : 0;
+            int32_t up_left  = (x >= 1) ? e1 [(x - 1) * 3 + c] : 0;
+            int32_t up    = e1 [x * 3 + c];
+            int32_t up_right = (x + 1 < width) ? e1 [(x + 1) * 3 + c] : 0;
+            int32_t incoming;
+
+            if (atkinson)
+            {
+                int32_t left_2 = (x >= 2) ? e0 [(x - 2) * 3 + c] : 0;
+                int32_t up_2   = e2 [x * 3 + c];
+                incoming = (left + left_2 + up_left + up + up_right + up_2) / 8;
+            }
+            else
+            {
+                incoming = (7 * left + 1 * up_left + 5 * up + 3 * up_right) / 16;
+            }
+
+            target [c] = std::min (255, std::max (0, rgb [x * 3 + c] + incoming));
+        }
+
+        uint8_t index = state->lut [RGB15 (target [0], target [1], target [2])];
+        indexed [x] = index;
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            e0 [x * 3 + c] = target [c] - state->palette_rgb [index][c];
+        }
+
+        if (x % DITHER_CHUNK == DITHER_CHUNK - 1)
+        {
+            state->progress [r].store (x + 1, std::memory_order_release);
+        }
+    }
+
+    state->progress [r].store (width, std::memory_order_release);
+}
+
+
+/*
+ * Worker: take rows in order until there are none left.
+ *
+ * Rows are claimed in order, so a row only ever waits on rows that
+ * have already been claimed by a running thread.
+ */
+static void dither_worker (void *data, uint32_t /* begin */, uint32_t /* end */)
+{
+    Dither_State *state = (Dither_State *) data;
+    uint32_t row;
+
+    while ((row = state->next_row++) < state->rows)
+    {
+        switch (state->mode)
+        {
+            case DITHER_ORDERED:
+                dither_row_ordered (state, row);
+                break;
+
+            case DITHER_FLOYD_STEINBERG:
+            case DITHER_ATKINSON:
+                dither_row_diffuse (state, row);
+                break;
+
+            default:
+                dither_row_none (state, row);
+                break;
+        }
+    }
+}
+
+
+/*
+ * Quantise rows [y, y + rows) of the image to palette indices.
+ */
+void dither_rows (Dither_State *state, const uint8_t *rgb, uint32_t y, uint32_t rows, uint8_t *indexed)
+{
+    size_t row_size = (size_t) state->width * 3;
+    TRACE_ZONE ("dither_rows");
+
+    state->rgb = rgb;
+    state->indexed = indexed;
+    state->y = y;
+    state->rows = rows;
+    state->next_row = 0;
+
+    if (state->mode == DITHER_FLOYD_STEINBERG || state->mode == DITHER_ATKINSON)
+    {
+        uint32_t buffer_rows = rows + DITHER_CARRY_ROWS;
+
+        if (state->error.empty ())
+        {
+            state->error.assign (row_size * buffer_rows, 0);
+        }
+        else
+        {
+            /* Carry the last two rows of error from the previous call */
+            size_t previous_rows = state->error.size () / row_size;
+            memmove (&state->error [0], &state->error [(previous_rows - DITHER_CARRY_ROWS) * row_size],
+                     DITHER_CARRY_ROWS * row_size * sizeof (int16_t));
+            state->error.resize (row_size * buffer_rows);
+        }
+
+        if (state->progress.size () < buffer_rows)
+        {
+            state->progress = std::vector<std::atomic<uint32_t>> (buffer_rows);
+        }
+        for (uint32_t r = 0; r < buffer_rows; r++)
+        {
+            state->progress [r] = 0;
+        }
+    }
+
+    jobs_parallel_for (std::min (rows, jobs_worker_count ()), 1, dither_worker, state);
+}
@@ -0,0 +1,45 @@
+#pragma once
+/*
+ * Dithering API.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+typedef enum Dither_Mode_e {
+    DITHER_NONE = 0,
+    DITHER_ORDERED,         /* Bayer 8×8 */
+    DITHER_FLOYD_STEINBERG,
+    DITHER_ATKINSON,
+    DITHER_MODE_COUNT
+} Dither_Mode;
+
+extern const char *dither_mode_names [DITHER_MODE_COUNT];
+
+typedef struct Dither_State_s {
+    Dither_Mode mode;
+    uint32_t width;
+    const uint8_t *lut;         /* 15-bit RGB to palette index */
+    uint8_t palette_rgb [16][3];
+
+    /* Error diffusion: quantisation error of each pixel, with two extra
+     * rows at the start carried over from the previous call. */
+    std::vector<int16_t> error;
+    std::vector<std::atomic<uint32_t>> progress;
+
+    /* Per-call work */
+    const uint8_t *rgb;
+    uint8_t *indexed;
+    uint32_t y;
+    uint32_t rows;
+    std::atomic<uint32_t> next_row;
+} Dither_State;
+
+/* Prepare to quantise an image of the given width, one group of rows at a time. */
+void dither_init (Dither_State *state, Dither_Mode mode, uint32_t width, const uint8_t *palette, const uint8_t *lut);
+
+/* Quantise rows [y, y + rows) of the image to palette indices. Rows must be passed in order.
+ * Intended to be called from within a job, as the work is spread across the job system. */
+void dither_rows (Dither_State *state, const uint8_t *rgb, uint32_t y, uint32_t rows, uint8_t *indexed);
@@ -0,0 +1,212 @@
+/*
+ * Image importer.
+ *
+ * Slices a truecolour image into 8×8 tiles, quantises each pixel to the
+ * nearest palette entry, and deduplicates the tiles into a tile store and
+ * tile map. Per-tile work is spread across the job system. Deduplication
+ * runs afterwards in raster order, so the output does not depend on the
+ * number of threads.
+ *
+ * Quantisation (with optional dithering) runs a row at a time before
+ * slicing, as error diffusion carries state between neighbouring tiles.
+ *
+ * The image is streamed in strips of 8 scanlines, so only a few rows of
+ * source pixels are held in memory at once, however large the image.
+ *
+ * Images are read in binary PPM (P6) format.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "colour.h"
+#include "dither.h"
+#include "jobs.h"
+#include "palette_optimise.h"
+#include "ppm.h"
+#include "tile_store.h"
+#include "trace.h"
+#include "import.h"
+
+#define IMPORT_BATCH_SIZE 256
+
+typedef struct Import_Work_s {
+    Job *job;
+    const uint8_t *indexed; /* Quantised rows for the strips being processed */
+    uint32_t width;
+    uint32_t rows;          /* Number of valid rows in indexed */
+    uint32_t tiles_x;
+    Tile *tiles;
+    uint64_t *hashes;
+} Import_Work;
+
+
+/*
+ * Slice, encode and hash a batch of tiles from the current strips.
+ */
+static void import_tiles (void *data, uint32_t begin, uint32_t end)
+{
+    Import_Work *work = (Import_Work *) data;
+    TRACE_ZONE ("import_tiles");
+
+    if (job_cancelled (work->job))
+    {
+        return;
+    }
+
+    for (uint32_t t = begin; t < end; t++)
+    {
+        uint32_t base_x = (t % work->tiles_x) * 8;
+        uint32_t base_y = (t / work->tiles_x) * 8;
+        Tile *tile = &work->tiles [t];
+
+        for (uint32_t y = 0; y < 8; y++)
+        {
+            for (uint32_t x = 0; x < 8; x++)
+            {
+                uint32_t px = base_x + x;
+                uint32_t py = base_y + y;
+
+                /* Partial tiles at the right and bottom edges are padded with index 0 */
+                if (px >= work->width || py >= work->rows)
+                {
+                    tile->pixel [x + y * 8] = 0;
+                    continue;
+                }
+
+                tile->pixel [x + y * 8] = work->indexed [px + (size_t) py * work->width];
+            }
+        }
+
+        tile_encode_planar (tile->pixel, tile->planar);
+        work->hashes [t] = tile_hash (tile->pixel);
+    }
+}
+
+
+/*
+ * Job function: import the image described by the Import_Context in job->data.
+ */
+void import_run (Job *job)
+{
+    Import_Context *context = (Import_Context *) job->data;
+    uint32_t width;
+    uint32_t height;
+
+    context->success = false;
+    tile_store_clear (&context->store);
+
+    /* Choose the palette with a first pass over the image */
+    if (context->optimise_palette)
+    {
+        std::vector<uint64_t> histogram (32768, 0);
+
+        if (!image_histogram_add (context->path.c_str (), histogram.data (), &context->error))
+        {
+            return;
+        }
+
+        if (job_cancelled (job))
+        {
+            context->error = "Cancelled";
+            return;
+        }
+
+        context->palette_error = palette_optimise (histogram.data (), context->palette, 0x0000,
+                                                   context->transparent);
+    }
+
+    FILE *file = ppm_open (context->path.c_str (), &width, &height, &context->error);
+    if (file == NULL)
+    {
+        return;
+    }
+
+    std::vector<uint8_t> lut (32768);
+    quantise_lut_build (context->palette, lut.data (), context->transparent);
+
+    uint32_t tiles_x = (width + 7) / 8;
+    uint32_t tiles_y = (height + 7) / 8;
+
+    context->map.width = tiles_x;
+    context->map.height = tiles_y;
+    context->map.entry.clear ();
+    context->map.entry.reserve ((size_t) tiles_x * tiles_y);
+
+    /* Take one strip per worker at a time, so that narrow images still keep every core busy */
+    uint32_t strips_per_pass = jobs_worker_count ();
+    std::vector<uint8_t> rgb ((size_t) width * 8 * 3 * strips_per_pass);
+    std::vector<uint8_t> indexed ((size_t) width * 8 * strips_per_pass);
+    std::vector<Tile> tiles ((size_t) tiles_x * strips_per_pass);
+    std::vector<uint64_t> hashes ((size_t) tiles_x * strips_per_pass);
+
+    Dither_State dither;
+    dither_init (&dither, context->dither, width, context->palette, lut.data ());
+
+    Import_Work work;
+    work.job = job;
+    work.indexed = indexed.data ();
+    work.width = width;
+    work.tiles_x = tiles_x;
+    work.tiles = tiles.data ();
+    work.hashes = hashes.data ();
+
+    for (uint32_t strip = 0; strip < tiles_y; strip += strips_per_pass)
+    {
+        uint32_t strips = std::min (strips_per_pass, tiles_y - strip);
+        uint32_t rows = std::min (strips * 8, height - strip * 8);
+
+        {
+            TRACE_ZONE ("ppm_read");
+
+            if (fread (rgb.data (), 1, (size_t) width * rows * 3, file) != (size_t) width * rows * 3)
+            {
+                context->error = "Image data is truncated";
+                fclose (file);
+                return;
+            }
+        }
+
+        /* Quantise, then slice into tiles */
+        dither_rows (&dither, rgb.data (), strip * 8, rows, indexed.data ());
+
+        work.rows = rows;
+        jobs_parallel_for (tiles_x * strips, IMPORT_BATCH_SIZE, import_tiles, &work);
+
+        if (job_cancelled (job))
+        {
+            context->error = "Cancelled";
+            fclose (file);
+            return;
+        }
+
+        /* Deduplicate in raster order */
+        {
+            TRACE_ZONE ("dedup");
+
+            for (uint32_t t = 0; t < tiles_x * strips; t++)
+            {
+                context->map.entry.push_back (tile_store_add (&context->store, &tiles [t], hashes [t]));
+            }
+        }
+
+        if (context->store.tiles.size () > TILE_INDEX_MASK + 1)
+        {
+            context->error = "Too many unique tiles";
+            tile_store_clear (&context->store);
+            fclose (file);
+            return;
+        }
+
+        job_set_progress (job, strip + strips, tiles_y);
+    }
+
+    fclose (file);
+
+    context->tiles_total = tiles_x * tiles_y;
+    context->success = true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+/*
+ * Image importer API.
+ */
+
+#include <stdint.h>
+
+#include <string>
+
+#include "dither.h"
+#include "tile_store.h"
+
+typedef struct Job_s Job;
+
+typedef struct Import_Context_s {
+    /* Options */
+    std::string path;
+    bool optimise_palette;  /* Replace the palette with one chosen for this image */
+    Dither_Mode dither;
+    uint8_t palette [16];
+    bool transparent;       /* Index 0 is transparent, so no pixel is given it */
+
+    /* Results */
+    bool success;
+    std::string error;
+    uint32_t tiles_total;
+    float palette_error;
+    Tile_Store store;
+    Tile_Map map;
+} Import_Context;
+
+/* Job function: import the image described by the Import_Context in job->data. */
+void import_run (Job *job);
@@ -0,0 +1,427 @@
+/*
+ * Background job system.
+ *
+ * Each worker thread owns a deque of tasks. Workers pop from the back of
+ * their own deque and steal from the front of the others when it runs dry.
+ * Finished jobs are handed back to the UI thread through a lock-free stack.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "jobs.h"
+#include "trace.h"
+
+typedef struct Task_s {
+    void (*fn) (void *data, uint32_t begin, uint32_t end);
+    void *data;
+    uint32_t begin;
+    uint32_t end;
+    std::atomic<uint32_t> *remaining;
+    uint64_t trace_flow;
+} Task;
+
+typedef struct Worker_s {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+} Worker;
+
+static std::vector<Worker *> workers;
+static thread_local int32_t worker_index = -1;
+static std::atomic<uint32_t> submit_index (0);
+
+/* Sleeping */
+static std::mutex sleep_mutex;
+static std::condition_variable sleep_cv;
+static std::atomic<uint32_t> queued_tasks (0);
+static std::atomic<bool> jobs_quit (false);
+
+/* Finished jobs, waiting for jobs_poll () */
+static std::atomic<Job *> completed_jobs (NULL);
+
+/* UI-thread list of jobs that have not yet completed */
+static std::vector<Job *> active_jobs;
+
+
+/*
+ * Push a task onto a worker's deque and wake a sleeping worker.
+ */
+static void task_push (const Task &task)
+{
+    /* Workers push to their own deque, other threads distribute round-robin */
+    uint32_t index = (worker_index >= 0) ? worker_index : submit_index++ % workers.size ();
+    Worker *worker = workers [index];
+
+    {
+        std::lock_guard<std::mutex> lock (worker->mutex);
+        worker->tasks.push_back (task);
+    }
+    queued_tasks++;
+
+    std::lock_guard<std::mutex> lock (sleep_mutex);
+    sleep_cv.notify_one ();
+}
+
+
+/*
+ * Take a task, preferring the newest task on our own deque,
+ * falling back to stealing the oldest task from another worker.
+ */
+static bool task_acquire (Task *task)
+{
+    uint32_t count = workers.size ();
+
+    if (queued_tasks.load () == 0)
+    {
+        return false;
+    }
+
+    if (worker_index >= 0)
+    {
+        Worker *worker = workers [worker_index];
+        std::lock_guard<std::mutex> lock (worker->mutex);
+
+        if (!worker->tasks.empty ())
+        {
+            *task = worker->tasks.back ();
+            worker->tasks.pop_back ();
+            queued_tasks--;
+            return true;
+        }
+    }
+
+    uint32_t start = (worker_index >= 0) ? worker_index + 1 : 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Worker *victim = workers [(start + i) % count];
+        std::lock_guard<std::mutex> lock (victim->mutex);
+
+        if (!victim->tasks.empty ())
+        {
+            *task = victim->tasks.front ();
+            victim->tasks.pop_front ();
+            queued_tasks--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * Run a task and signal its completion.
+ */
+static void task_run (const Task &task)
+{
+    TRACE_ZONE ("task");
+    trace_flow_end ("task", task.trace_flow);
+
+    task.fn (task.data, task.begin, task.end);
+
+    if (task.remaining != NULL)
+    {
+        task.remaining->fetch_sub (1, std::memory_order_release);
+    }
+}
+
+
+/*
+ * Task wrapper for a whole job. Hands the job back to the UI thread once it has run.
+ */
+static void job_execute (void *data, uint32_t /* begin */, uint32_t /* end */)
+{
+    Job *job = (Job *) data;
+
+    {
+        TRACE_ZONE (job->name);
+        trace_flow_step ("job", job->trace_flow);
+
+        if (!job_cancelled (job))
+        {
+            job->run (job);
+        }
+    }
+
+    /* Lock-free push onto the completed stack */
+    job->next = completed_jobs.load (std::memory_order_relaxed);
+    while (!completed_jobs.compare_exchange_weak (job->next, job, std::memory_order_release,
+                                                  std::memory_order_relaxed))
+    {
+    }
+}
+
+
+/*
+ * Worker thread main loop.
+ */
+static void worker_main (int32_t index)
+{
+    Task task;
+    char name [32];
+
+    worker_index = index;
+    snprintf (name, sizeof (name), "Worker %d", index);
+    trace_thread_name (name);
+
+    while (!jobs_quit)
+    {
+        if (task_acquire (&task))
+        {
+            task_run (task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock (sleep_mutex);
+        sleep_cv.wait (lock, [] { return jobs_quit || queued_tasks.load () > 0; });
+    }
+}
+
+
+/*
+ * Start count worker threads, or one per core if count is zero.
+ */
+void jobs_init (uint32_t count)
+{
+    if (count == 0)
+    {
+        count = std::max (1u, std::thread::hardware_concurrency ());
+    }
+
+    jobs_quit = false;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        workers.push_back (new Worker);
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        workers [i]->thread = std::thread (worker_main, i);
+    }
+}
+
+
+/*
+ * Cancel outstanding jobs and stop the worker threads.
+ */
+void jobs_shutdown (void)
+{
+    {
+        std::lock_guard<std::mutex> lock (sleep_mutex);
+        jobs_quit = true;
+        sleep_cv.notify_all ();
+    }
+
+    for (Worker *worker : workers)
+    {
+        worker->thread.join ();
+    }
+
+    for (Worker *worker : workers)
+    {
+        delete worker;
+    }
+    workers.clear ();
+
+    /* Jobs still queued never ran, and finished jobs will not be polled */
+    for (Job *job : active_jobs)
+    {
+        if (job->discard != NULL)
+        {
+            job->discard (job);
+        }
+        delete job;
+    }
+    active_jobs.clear ();
+    completed_jobs = NULL;
+}
+
+
+/*
+ * Queue a job.
+ */
+Job *job_submit (const char *name, void (*run) (Job *job), void (*complete) (Job *job),
+                 void (*discard) (Job *job), void *data)
+{
+    Job *job = new Job;
+
+    job->name = name;
+    job->run = run;
+    job->complete = complete;
+    job->discard = discard;
+    job->data = data;
+    job->progress = 0;
+    job->progress_total = 0;
+    job->cancelled = false;
+    job->trace_flow = trace_flow_begin ("job");
+    job->next = NULL;
+
+    active_jobs.push_back (job);
+
+    Task task = { job_execute, job, 0, 0, NULL, 0 };
+    task_push (task);
+
+    return job;
+}
+
+
+/*
+ * Request cancellation.
+ */
+void job_cancel (Job *job)
+{
+    job->cancelled = true;
+}
+
+
+/*
+ * Check if a job should stop early.
+ */
+bool job_cancelled (Job *job)
+{
+    return job->cancelled.load (std::memory_order_relaxed) || jobs_quit.load (std::memory_order_relaxed);
+}
+
+
+/*
+ * Update a job's progress.
+ */
+void job_set_progress (Job *job, uint32_t progress, uint32_t total)
+{
+    job->progress_total.store (total, std::memory_order_relaxed);
+    job->progress.store (progress, std::memory_order_relaxed);
+}
+
+
+/*
+ * Get a job's progress as a fraction.
+ */
+float job_progress (Job *job)
+{
+    uint32_t total = job->progress_total.load (std::memory_order_relaxed);
+    uint32_t progress = job->progress.load (std::memory_order_relaxed);
+
+    if (total == 0)
+    {
+        return 0.0f;
+    }
+
+    return std::min (1.0f, (float) progress / total);
+}
+
+
+/*
+ * Run fn over [0, count) in batches across all workers.
+ */
+void jobs_parallel_for (uint32_t count, uint32_t batch_size,
+                        void (*fn) (void *data, uint32_t begin, uint32_t end), void *data)
+{
+    uint32_t batches = (count + batch_size - 1) / batch_size;
+    std::atomic<uint32_t> remaining (batches);
+    Task task;
+
+    if (batches == 0)
+    {
+        return;
+    }
+
+    /* Keep the first batch for ourselves */
+    for (uint32_t batch = 1; batch < batches; batch++)
+    {
+        uint32_t begin = batch * batch_size;
+        Task batch_task = { fn, data, begin, std::min (count, begin + batch_size), &remaining,
+                            trace_flow_begin ("task") };
+        task_push (batch_task);
+    }
+
+    {
+        TRACE_ZONE ("task");
+        fn (data, 0, std::min (count, batch_size));
+    }
+    remaining--;
+
+    /* Help out until every batch has finished */
+    TRACE_ZONE ("parallel_for wait");
+    while (remaining.load (std::memory_order_acquire) > 0)
+    {
+        if (task_acquire (&task))
+        {
+            task_run (task);
+        }
+        else
+        {
+            std::this_thread::yield ();
+        }
+    }
+}
+
+
+/*
+ * Number of worker threads.
+ */
+uint32_t jobs_worker_count (void)
+{
+    return workers.size ();
+}
+
+
+/*
+ * Run the complete callbacks of finished jobs.
+ */
+void jobs_poll (void)
+{
+    Job *list = completed_jobs.exchange (NULL, std::memory_order_acquire);
+    Job *ordered = NULL;
+
+    /* The stack is newest-first, reverse it to complete jobs in the order they finished */
+    while (list != NULL)
+    {
+        Job *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    while (ordered != NULL)
+    {
+        Job *job = ordered;
+        ordered = job->next;
+
+        if (job->complete != NULL)
+        {
+            TRACE_ZONE ("complete");
+            trace_flow_end ("job", job->trace_flow);
+            job->complete (job);
+        }
+
+        active_jobs.erase (std::remove (active_jobs.begin (), active_jobs.end (), job), active_jobs.end ());
+        delete job;
+    }
+}
+
+
+/*
+ * Number of jobs that have not yet completed.
+ */
+uint32_t jobs_active_count (void)
+{
+    return active_jobs.size ();
+}
+
+
+/*
+ * Get an active job for display.
+ */
+Job *jobs_active_get (uint32_t index)
+{
+    return active_jobs [index];
+}
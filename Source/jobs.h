@@ -0,0 +1,60 @@
+#pragma once
+/*
+ * Background job system API.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+
+typedef struct Job_s Job;
+
+struct Job_s {
+    const char *name;
+    void (*run) (Job *job);         /* Called on a worker thread */
+    void (*complete) (Job *job);    /* Called on the UI thread from jobs_poll () */
+    void (*discard) (Job *job);     /* Called instead of complete for jobs left over at jobs_shutdown () */
+    void *data;
+
+    std::atomic<uint32_t> progress;
+    std::atomic<uint32_t> progress_total;
+    std::atomic<bool> cancelled;
+
+    uint64_t trace_flow;            /* Links submit, run and complete in a trace */
+    Job *next;
+};
+
+/* Start count worker threads, or one per core if count is zero. */
+void jobs_init (uint32_t count);
+
+/* Cancel outstanding jobs and stop the worker threads. Jobs that have not completed are discarded. */
+void jobs_shutdown (void);
+
+/* Queue a job. The job is freed after its complete or discard callback has run. */
+Job *job_submit (const char *name, void (*run) (Job *job), void (*complete) (Job *job),
+                 void (*discard) (Job *job), void *data);
+
+/* Request cancellation. The job's run function is expected to poll job_cancelled (). */
+void job_cancel (Job *job);
+
+/* True if the job has been cancelled or the application is shutting down. */
+bool job_cancelled (Job *job);
+
+/* Progress reporting, safe to call from any thread. */
+void job_set_progress (Job *job, uint32_t progress, uint32_t total);
+float job_progress (Job *job);
+
+/* Run fn over [0, count) in batches across all workers, returning when every batch is done.
+ * Intended to be called from within a job; the calling thread helps with the work. */
+void jobs_parallel_for (uint32_t count, uint32_t batch_size,
+                        void (*fn) (void *data, uint32_t begin, uint32_t end), void *data);
+
+/* Number of worker threads. */
+uint32_t jobs_worker_count (void);
+
+/* Run the complete callbacks of finished jobs. Called once per frame on the UI thread, never blocks. */
+void jobs_poll (void);
+
+/* Jobs that have been submitted but not yet completed, for display on the UI thread. */
+uint32_t jobs_active_count (void);
+Job *jobs_active_get (uint32_t index);
@@ -0,0 +1,460 @@
+/*
+ * Autosave journal.
+ *
+ * Every edit is appended to a write-ahead log by a background thread, which
+ * fsyncs in batches. Periodically the log is compacted into the project file.
+ * A non-empty log at startup means the previous session did not exit cleanly.
+ *
+ * Each compaction starts a new generation, whose number is written into both
+ * the project file and the header of the emptied log. Should the session stop
+ * after the project file is replaced but before the log is emptied, the log
+ * still carries the previous generation, and its records, which the new
+ * project file already includes, are not replayed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "journal.h"
+
+#define JOURNAL_RECORD_SIZE     8
+#define JOURNAL_HEADER_SIZE     8   /* Magic, then the generation */
+#define JOURNAL_BATCH_MS        250
+#define JOURNAL_MAGIC           "SNEJ"
+#define PROJECT_MAGIC           "SNEP"
+#define PROJECT_VERSION         3   /* Version 1 had no generation, versions 1 and 2 held one document */
+
+/* Paths */
+static std::string project_path;
+static std::string project_tmp_path;
+static std::string journal_path;
+
+/* Writer thread */
+static std::thread writer_thread;
+static std::mutex writer_mutex;
+static std::condition_variable writer_cv;
+static int journal_fd = -1;
+static uint32_t journal_generation = 0;     /* Of the project file, written only by the writer once started */
+
+/* Shared with the writer, protected by writer_mutex */
+static std::vector<Journal_Record> pending_records;
+static std::vector<uint8_t> pending_snapshot;
+static bool snapshot_requested = false;
+static bool writer_quit = false;
+
+
+/*
+ * Checksum used to reject torn or garbage records at the tail of the journal.
+ */
+static uint32_t journal_checksum (const uint8_t *data)
+{
+    uint32_t hash = 0x811c9dc5;
+
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        hash = (hash ^ data [i]) * 0x01000193;
+    }
+
+    return hash;
+}
+
+
+/*
+ * Serialise a record into its on-disk form.
+ */
+static void journal_encode (const Journal_Record *record, uint8_t *data)
+{
+    data [0] = record->type;
+    data [1] = record->value;
+    data [2] = record->index & 0xff;
+    data [3] = record->index >> 8;
+
+    uint32_t check = journal_checksum (data);
+    data [4] = check >> 0;
+    data [5] = check >> 8;
+    data [6] = check >> 16;
+    data [7] = check >> 24;
+}
+
+
+/*
+ * Deserialise a record, returns false if the checksum does not match.
+ */
+static bool journal_decode (const uint8_t *data, Journal_Record *record)
+{
+    uint32_t check = data [4] | (data [5] << 8) | (data [6] << 16) | ((uint32_t) data [7] << 24);
+
+    if (check != journal_checksum (data))
+    {
+        return false;
+    }
+
+    record->type  = data [0];
+    record->value = data [1];
+    record->index = data [2] | (data [3] << 8);
+
+    return true;
+}
+
+
+/*
+ * Write a buffer in full, retrying on short writes.
+ */
+static bool write_all (int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write (fd, data, size);
+
+        if (written < 0)
+        {
+            return false;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+
+/*
+ * Store a 32-bit value in little-endian order.
+ */
+static void write_u32 (uint8_t *data, uint32_t value)
+{
+    data [0] = value >> 0;
+    data [1] = value >> 8;
+    data [2] = value >> 16;
+    data [3] = value >> 24;
+}
+
+
+/*
+ * Load a 32-bit value stored in little-endian order.
+ */
+static uint32_t read_u32 (const uint8_t *data)
+{
+    return data [0] | (data [1] << 8) | (data [2] << 16) | ((uint32_t) data [3] << 24);
+}
+
+
+/*
+ * Empty the journal, leaving just the header for the current generation.
+ */
+static bool journal_reset (void)
+{
+    uint8_t header [JOURNAL_HEADER_SIZE] = { 'S', 'N', 'E', 'J' };
+    write_u32 (&header [4], journal_generation);
+
+    if (ftruncate (journal_fd, 0) != 0 || !write_all (journal_fd, header, sizeof (header)))
+    {
+        fprintf (stderr, "Unable to reset %s.\n", journal_path.c_str ());
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Atomically replace the project file with a snapshot.
+ */
+static bool project_write (const std::vector<uint8_t> &snapshot, uint32_t generation)
+{
+    uint8_t header [12] = { 'S', 'N', 'E', 'P', PROJECT_VERSION };
+    uint32_t size = snapshot.size ();
+
+    header [5] = size & 0xff;
+    header [6] = size >> 8;
+    header [7] = size >> 16;
+    write_u32 (&header [8], generation);
+
+    int fd = open (project_tmp_path.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        fprintf (stderr, "Unable to create %s.\n", project_tmp_path.c_str ());
+        return false;
+    }
+
+    bool ok = write_all (fd, header, sizeof (header)) &&
+              write_all (fd, snapshot.data (), snapshot.size ()) &&
+              fsync (fd) == 0;
+    close (fd);
+
+    if (!ok || rename (project_tmp_path.c_str (), project_path.c_str ()) != 0)
+    {
+        fprintf (stderr, "Unable to write %s.\n", project_path.c_str ());
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Background writer. Batches up pending records so that
+ * each fsync covers every edit made since the last one.
+ */
+static void journal_writer (void)
+{
+    std::vector<Journal_Record> records;
+    std::vector<uint8_t> snapshot;
+    std::vector<uint8_t> buffer;
+
+    while (true)
+    {
+        bool quit;
+        bool compact;
+
+        {
+            std::unique_lock<std::mutex> lock (writer_mutex);
+            writer_cv.wait (lock, [] { return writer_quit || snapshot_requested || !pending_records.empty (); });
+
+            records.swap (pending_records);
+            compact = snapshot_requested;
+            if (compact)
+            {
+                snapshot.swap (pending_snapshot);
+                snapshot_requested = false;
+            }
+            quit = writer_quit;
+        }
+
+        /* Records pending at the time of the snapshot were discarded by
+         * journal_compact, so anything left in records is newer. */
+        if (compact && project_write (snapshot, journal_generation + 1))
+        {
+            journal_generation++;
+            journal_reset ();
+        }
+
+        if (!records.empty ())
+        {
+            buffer.resize (records.size () * JOURNAL_RECORD_SIZE);
+            for (uint32_t i = 0; i < records.size (); i++)
+            {
+                journal_encode (&records [i], &buffer [i * JOURNAL_RECORD_SIZE]);
+            }
+            records.clear ();
+
+            if (!write_all (journal_fd, buffer.data (), buffer.size ()))
+            {
+                fprintf (stderr, "Unable to write to %s.\n", journal_path.c_str ());
+            }
+        }
+
+        fsync (journal_fd);
+
+        if (quit)
+        {
+            break;
+        }
+
+        /* Let further edits accumulate before the next fsync */
+        std::unique_lock<std::mutex> lock (writer_mutex);
+        writer_cv.wait_for (lock, std::chrono::milliseconds (JOURNAL_BATCH_MS), [] { return writer_quit; });
+    }
+}
+
+
+/*
+ * Set the file paths used by the journal.
+ */
+static void journal_set_paths (const char *directory)
+{
+    project_path = std::string (directory) + "autosave.snep";
+    project_tmp_path = project_path + ".tmp";
+    journal_path = std::string (directory) + "autosave.journal";
+}
+
+
+/*
+ * Load the project file into the snapshot buffer.
+ * Returns false if there is no compatible project file.
+ */
+bool journal_load_project (const char *directory, std::vector<uint8_t> *snapshot, uint32_t *version)
+{
+    uint8_t header [12] = { 0 };
+    bool loaded = false;
+
+    journal_set_paths (directory);
+    journal_generation = 0;
+
+    FILE *file = fopen (project_path.c_str (), "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    /* Version 1 files end their header before the generation, and count as generation zero */
+    if (fread (header, 1, 8, file) == 8 &&
+        memcmp (header, PROJECT_MAGIC, 4) == 0 && header [4] >= 1 && header [4] <= PROJECT_VERSION &&
+        (header [4] == 1 || fread (&header [8], 1, 4, file) == 4))
+    {
+        uint32_t size = header [5] | (header [6] << 8) | (header [7] << 16);
+
+        snapshot->resize (size);
+        loaded = fread (snapshot->data (), 1, size, file) == size;
+        journal_generation = read_u32 (&header [8]);
+        *version = header [4];
+    }
+
+    if (!loaded)
+    {
+        fprintf (stderr, "%s is not a compatible project file.\n", project_path.c_str ());
+    }
+
+    fclose (file);
+
+    return loaded;
+}
+
+
+/*
+ * Pass any records left in the journal by a previous session to apply, in order.
+ * Returns the number of records replayed.
+ */
+uint32_t journal_replay (const char *directory, void (*apply) (const Journal_Record *record))
+{
+    uint8_t data [JOURNAL_RECORD_SIZE];
+    Journal_Record record;
+    uint32_t replayed = 0;
+
+    journal_set_paths (directory);
+
+    FILE *file = fopen (journal_path.c_str (), "rb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    /* Records from an earlier generation are already in the project file */
+    uint8_t header [JOURNAL_HEADER_SIZE];
+    if (fread (header, 1, sizeof (header), file) != sizeof (header) ||
+        memcmp (header, JOURNAL_MAGIC, 4) != 0 || read_u32 (&header [4]) != journal_generation)
+    {
+        fclose (file);
+        return 0;
+    }
+
+    while (fread (data, 1, sizeof (data), file) == sizeof (data))
+    {
+        if (!journal_decode (data, &record))
+        {
+            fprintf (stderr, "Discarding corrupt journal tail.\n");
+            break;
+        }
+        apply (&record);
+        replayed++;
+    }
+
+    fclose (file);
+
+    if (replayed)
+    {
+        fprintf (stderr, "Recovered %u unsaved edits from %s.\n", replayed, journal_path.c_str ());
+    }
+
+    return replayed;
+}
+
+
+/*
+ * Start the background writer.
+ */
+int journal_open (const char *directory)
+{
+    journal_set_paths (directory);
+
+    journal_fd = open (journal_path.c_str (), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (journal_fd < 0)
+    {
+        fprintf (stderr, "Unable to open %s, autosave is disabled.\n", journal_path.c_str ());
+        return -1;
+    }
+
+    /* Keep replayed records of the current generation, but start afresh after any other */
+    uint8_t header [JOURNAL_HEADER_SIZE];
+    if (pread (journal_fd, header, sizeof (header), 0) != sizeof (header) ||
+        memcmp (header, JOURNAL_MAGIC, 4) != 0 || read_u32 (&header [4]) != journal_generation)
+    {
+        journal_reset ();
+    }
+
+    writer_quit = false;
+    writer_thread = std::thread (journal_writer);
+
+    return 0;
+}
+
+
+/*
+ * Append an edit to the journal.
+ */
+void journal_append (uint8_t type, uint16_t index, uint8_t value)
+{
+    if (journal_fd < 0)
+    {
+        return;
+    }
+
+    Journal_Record record = { type, value, index };
+
+    std::lock_guard<std::mutex> lock (writer_mutex);
+    pending_records.push_back (record);
+    writer_cv.notify_one ();
+}
+
+
+/*
+ * Replace the project file with a snapshot of the current state.
+ * The snapshot is copied, the write happens on the background thread.
+ */
+void journal_compact (const uint8_t *snapshot, uint32_t snapshot_size)
+{
+    if (journal_fd < 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock (writer_mutex);
+    pending_snapshot.assign (snapshot, snapshot + snapshot_size);
+    pending_records.clear ();
+    snapshot_requested = true;
+    writer_cv.notify_one ();
+}
+
+
+/*
+ * Flush outstanding writes and stop the background writer.
+ */
+void journal_close (void)
+{
+    if (journal_fd < 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock (writer_mutex);
+        writer_quit = true;
+        writer_cv.notify_one ();
+    }
+
+    writer_thread.join ();
+    close (journal_fd);
+    journal_fd = -1;
+}
@@ -0,0 +1,55 @@
+#pragma once
+/*
+ * Autosave journal API.
+ */
+
+#include <stdint.h>
+
+#include <vector>
+
+typedef enum Journal_Type_e {
+    JOURNAL_PIXEL             = 1, /* index = pixel within tile [], value = palette index */
+    JOURNAL_TILE_COUNT        = 2, /* value = tiles along each axis */
+    JOURNAL_PALETTE           = 3, /* index = palette entry, value = 6-bit SMS colour */
+    JOURNAL_DOCUMENT          = 4, /* index = document, which the records that follow apply to */
+    JOURNAL_METASPRITE_PIXEL  = 5, /* index = pixel within metasprite_canvas [], value = palette index */
+    JOURNAL_METASPRITE_CLEAR  = 6, /* Clear the metasprite canvas */
+    JOURNAL_METASPRITE_ORIGIN = 7, /* index = 0 for x or 1 for y, value = origin, moving the entries with it */
+    JOURNAL_METASPRITE_COUNT  = 8, /* index = number of entries, new ones zeroed, value = 1 for 8×16 sprites */
+    JOURNAL_METASPRITE_REMOVE = 9, /* index = entry to remove */
+    JOURNAL_METASPRITE_ENTRY  = 10, /* index = entry | field << 12, value = byte of the field */
+} Journal_Type;
+
+/* Fields of a metasprite entry, as set by JOURNAL_METASPRITE_ENTRY */
+#define JOURNAL_ENTRY_FIELD_SHIFT   12
+#define JOURNAL_ENTRY_INDEX_MASK    0x0fff
+typedef enum Journal_Entry_Field_e {
+    JOURNAL_ENTRY_X = 0,            /* Signed */
+    JOURNAL_ENTRY_Y,                /* Signed */
+    JOURNAL_ENTRY_PATTERN_LOW,
+    JOURNAL_ENTRY_PATTERN_HIGH,
+} Journal_Entry_Field;
+
+typedef struct Journal_Record_s {
+    uint8_t  type;
+    uint8_t  value;
+    uint16_t index;
+} Journal_Record;
+
+/* Load the project file into the snapshot buffer, with the version of the file it came from. */
+bool journal_load_project (const char *directory, std::vector<uint8_t> *snapshot, uint32_t *version);
+
+/* Replay edits left in the journal by a session that did not exit cleanly. */
+uint32_t journal_replay (const char *directory, void (*apply) (const Journal_Record *record));
+
+/* Start the background writer. */
+int journal_open (const char *directory);
+
+/* Append an edit to the journal. Never blocks on IO. */
+void journal_append (uint8_t type, uint16_t index, uint8_t value);
+
+/* Replace the project file with a snapshot, and discard the journal records it covers. */
+void journal_compact (const uint8_t *snapshot, uint32_t snapshot_size);
+
+/* Flush outstanding writes and stop the background writer. */
+void journal_close (void);
@@ -1,15 +1,41 @@
+#include <float.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include <GL/gl3w.h>
 #include <SDL2/SDL.h>
 
 #include "imgui.h"
+#include "imgui_internal.h"
 #include "examples/imgui_impl_sdl.h"
 #include "examples/imgui_impl_opengl3.h"
 
+#include "jobs.h"
+#include "journal.h"
+#include "tile_store.h"
+#include "tile_atlas.h"
+#include "mip.h"
+#include "dither.h"
+#include "import.h"
+#include "metasprite.h"
+#include "animation.h"
+#include "palette_optimise.h"
+#include "tile_reduce.h"
+#include "trace.h"
+#include "ui_hooks.h"
+#include "vblank.h"
+#include "vdp.h"
+#include "vram.h"
+
 #define BORDER_SIZE 8
+#define AUTOSAVE_INTERVAL_MS 30000
+#define BENCHMARK_UI_WIDTH 1280
+#define BENCHMARK_UI_HEIGHT 720
 
 /* Global state */
 bool running = true;
@@ -20,6 +46,7 @@ int host_height;
 
 /* Gui calculations */
 uint32_t palette_bar_height = 0;
+bool right_button_used = false; /* The item under the mouse last frame handles the right button itself */
 
 /* 16-colour palette */
 uint8_t active_palette_index = 0;
@@ -33,11 +60,166 @@ const char *palette_strings [16] = { "0", "1", "2", "3",
 };
 
 
+/* Zoom and pan of a scrolling image */
+typedef struct Canvas_View_s {
+    float zoom;         /* Screen pixels per image pixel, as drawn */
+    float zoom_target;  /* Approached smoothly by zoom */
+    ImVec2 anchor;      /* Screen position held still while zooming */
+    ImVec2 pan;         /* Image position at the top-left of the view */
+} Canvas_View;
+
 /* 8 × 8 pixel tiles */
 #define MAX_TILES 4
 uint32_t tile_count = 1; /* Tile count along each axis */
 uint8_t tile [64 * MAX_TILES] = { 0 };
 char tile_strings [256][8] = { { '\0' } };
+Canvas_View canvas_view = { 0.0f, 0.0f, ImVec2 (0.0f, 0.0f), ImVec2 (0.0f, 0.0f) };
+uint32_t canvas_fit = 0; /* Pixel size at which the canvas fills the editing area */
+
+/* Sprite size: 8×8, or 8×16 using even/odd tile pairs */
+bool sprite_8x16 = false;
+
+/* Imported tiles */
+Tile_Store tile_store;
+Tile_Map tile_map;
+Job *import_job = NULL;
+bool import_dialog_open = false;
+char import_path [256] = { '\0' };
+char import_status [256] = { '\0' };
+bool import_optimise_palette = false;
+int import_dither = DITHER_NONE;
+
+/* Tile count reduction */
+Job *reduce_job = NULL;
+bool reduce_dialog_open = false;
+int reduce_budget = 448;
+char reduce_status [256] = { '\0' };
+bool reduce_undo_available = false;
+Tile_Store reduce_undo_store;
+Tile_Map reduce_undo_map;
+
+/* VRAM planner */
+bool vram_window_open = false;
+Vram_Plan vram_layout;
+char vram_new_name [32] = { '\0' };
+int vram_new_tiles = 16;
+bool vram_new_sprite = false;
+
+/* VDP preview */
+bool vdp_window_open = false;
+Vdp_Scene vdp_scene;
+GLuint vdp_texture = 0;
+uint32_t vdp_pixels [VDP_WIDTH * VDP_HEIGHT];
+uint8_t vdp_line_sprites [VDP_HEIGHT];
+int vdp_zoom = 2;
+bool vdp_heat_map = true;
+
+/* Tileset browser */
+bool tileset_window_open = false;
+Tile_Atlas tile_atlas;
+int tileset_zoom = 2;
+
+/* Tile map view */
+#define MAP_LOAD_PIXELS_PER_FRAME (1 << 19)
+bool map_window_open = false;
+Mip_Chain map_mip;
+uint32_t map_mip_rows = 0;  /* Tile rows loaded into map_mip so far */
+Canvas_View map_view = { 0.0f, 0.0f, ImVec2 (0.0f, 0.0f), ImVec2 (0.0f, 0.0f) };
+
+/* Documents, shown as tabs. The active document's state lives in globals; the
+ * others hold theirs in a Document_State until they are selected. Everything
+ * that refers to tiles by their index in the tile store belongs to the
+ * document, so that sprites and plans follow the tiles they point into. */
+typedef struct Document_State_s {
+    uint8_t palette [16];
+    uint32_t tile_count;
+    uint8_t tile [64 * MAX_TILES];
+    Canvas_View canvas_view;
+    uint32_t canvas_fit;
+    Tile_Store tile_store;
+    Tile_Map tile_map;
+    bool reduce_undo_available;
+    Tile_Store reduce_undo_store;
+    Tile_Map reduce_undo_map;
+    Tile_Atlas tile_atlas;
+    Mip_Chain map_mip;
+    uint32_t map_mip_rows;
+    Canvas_View map_view;
+    bool sprite_8x16;
+    Vram_Plan vram_layout;
+    Vdp_Scene vdp_scene;
+    Metasprite metasprite;
+    uint8_t metasprite_canvas [METASPRITE_CANVAS_MAX * METASPRITE_CANVAS_MAX];
+    Animation animation;
+} Document_State;
+
+typedef struct Document_s {
+    char name [64];
+    uint32_t id;            /* For the tab's ImGui id, which must not change with the name */
+    Document_State state;   /* Unused while the document is active */
+} Document;
+
+std::vector<Document *> documents;
+uint32_t document_active = 0;
+uint32_t document_next_id = 1;
+uint32_t document_shown_id = 0;     /* Tab shown by the tab bar, which follows document_active a frame late */
+bool renderer_headless = false;     /* No OpenGL context, as for --benchmark-ui without --gl */
+
+/* Metasprite editor */
+bool metasprite_window_open = false;
+Metasprite metasprite;
+uint8_t metasprite_canvas [METASPRITE_CANVAS_MAX * METASPRITE_CANVAS_MAX] = { 0 };
+int metasprite_width = 32;
+int metasprite_height = 32;
+char metasprite_label [32] = "metasprite";
+char metasprite_status [256] = { '\0' };
+
+/* Animation timeline */
+bool animation_window_open = false;
+Animation animation;
+char animation_label [32] = "animation";
+char animation_status [256] = { '\0' };
+
+/* VBlank analyser */
+bool vblank_window_open = false;
+Vblank_Settings vblank_settings = { VBLANK_NTSC, VBLANK_OTIR, 2000, true };
+std::vector<Vblank_Report> vblank_frame_reports;
+
+/* Shared palette optimisation */
+Job *palette_job = NULL;
+bool palette_dialog_open = false;
+char palette_paths [4096] = { '\0' };
+char palette_status [256] = { '\0' };
+bool palette_locked [16] = { false };
+bool palette_transparent = true;
+
+/* Performance HUD */
+#define HUD_HISTORY 240
+#define HUD_BUCKETS 32          /* Frame time histogram, 1 ms per bucket */
+bool hud_open = false;
+float hud_frame_ms [HUD_HISTORY] = { 0.0f };
+uint32_t hud_frame_index = 0;
+uint32_t hud_texture_bytes = 0;         /* Uploaded by the editor itself this frame */
+uint32_t hud_texture_bytes_last = 0;
+uint32_t hud_items_last = 0;
+int hud_vertices_last = 0;
+int hud_indices_last = 0;
+int hud_cmd_lists_last = 0;
+
+/* Tracing */
+const char *trace_path = "snepsprite-trace.json";
+
+/* Autosave */
+char *autosave_directory = NULL;
+bool autosave_dirty = false;
+uint32_t autosave_last_compact = 0;
+uint32_t journal_document = 0;  /* Document that the records since the last compaction apply to */
+#define PROJECT_DOCUMENT_SIZE (1 + sizeof (palette) + sizeof (tile))
+#define PROJECT_METASPRITE_SIZE (sizeof (metasprite_canvas) + 5)   /* Then six bytes per entry */
+#define PROJECT_METASPRITE_ENTRIES_MAX (JOURNAL_ENTRY_INDEX_MASK + 1)
+#define PROJECT_NAME_SIZE 64
+#define PROJECT_HEADER_SIZE 4   /* Document count, then the active document */
+
 
 /*
  * Convert a 6-bit SMS colour into an ImColor.
@@ -60,6 +242,20 @@ ImVec4 sms_to_imgui_colour (uint8_t colour, uint8_t hilight)
 }
 
 
+/*
+ * Stop recording and write the trace out.
+ */
+void trace_save (void)
+{
+    trace_stop ();
+
+    if (trace_write (trace_path) == 0)
+    {
+        fprintf (stderr, "Trace written to %s.\n", trace_path);
+    }
+}
+
+
 /*
  * Export palette to stdout.
  */
@@ -87,12 +283,11 @@ void export_palette (void)
 
 
 /*
- * Export palette to stdout.
+ * Export tile to stdout.
  */
 void export_tile (bool use_uint32)
 {
-    uint8_t plane [4] = { 0 };
-    uint32_t tile_base = 0;
+    uint8_t planar [32];
 
     printf ("const uint%d_t patterns [] = {\n", use_uint32 ? 32 : 8);
 
@@ -102,20 +297,12 @@ void export_tile (bool use_uint32)
                                   tile_num == 1 ? "Top right" :
                                   tile_num == 2 ? "Bottom left" :
                                   tile_num == 3 ? "Bottom right" : "?");
+
+        tile_encode_planar (&tile [tile_num * 64], planar);
+
         for (uint32_t row = 0; row < 8; row++)
         {
-            memset (plane, 0,  sizeof (plane));
-
-            for (uint32_t col = 0; col < 8; col++)
-            {
-                for (uint32_t bit = 0; bit < 4; bit++)
-                {
-                    if (tile [(tile_num * 64) + col + (row * 8)] & (1 << bit))
-                    {
-                       plane [bit] |= 0x80 >> col;
-                    }
-                }
-            }
+            uint8_t *plane = &planar [row * 4];
 
             if (use_uint32)
             {
@@ -133,63 +320,2157 @@ void export_tile (bool use_uint32)
             }
             else
             {
-                printf (" ");
+                printf (" ");
+            }
+        }
+    }
+
+    printf ("};\n");
+}
+
+
+/*
+ * Export the imported tiles to stdout.
+ */
+void export_tileset (void)
+{
+    printf ("const uint8_t tileset_patterns [] = {\n");
+
+    for (uint32_t tile_num = 0; tile_num < tile_store.tiles.size (); tile_num++)
+    {
+        const uint8_t *planar = tile_store.tiles [tile_num].planar;
+
+        printf ("    /* Tile %u */\n", tile_num);
+
+        for (uint32_t row = 0; row < 8; row++)
+        {
+            printf ("    0x%02x, 0x%02x, 0x%02x, 0x%02x,",
+                    planar [row * 4 + 0], planar [row * 4 + 1], planar [row * 4 + 2], planar [row * 4 + 3]);
+            printf ((row % 4) == 3 ? "\n" : " ");
+        }
+    }
+
+    printf ("};\n");
+}
+
+
+/*
+ * Export the imported tile map to stdout, as VDP name table entries.
+ */
+void export_tile_map (void)
+{
+    if (tile_store.tiles.size () > 512)
+    {
+        fprintf (stderr, "Warning: %u unique tiles will not fit in VRAM.\n", (uint32_t) tile_store.tiles.size ());
+    }
+
+    printf ("/* %u × %u tiles */\n", tile_map.width, tile_map.height);
+    printf ("const uint16_t tile_map [] = {\n");
+
+    for (uint32_t y = 0; y < tile_map.height; y++)
+    {
+        printf ("   ");
+        for (uint32_t x = 0; x < tile_map.width; x++)
+        {
+            printf (" 0x%04x,", TILE_NAME_TABLE_ENTRY (tile_map.entry [x + y * tile_map.width]));
+        }
+        printf ("\n");
+    }
+
+    printf ("};\n");
+}
+
+
+/*
+ * Start reloading the tile map view, after the map or tile store has been replaced.
+ */
+void map_view_reset (void)
+{
+    mip_resize (&map_mip, tile_map.width * 8, tile_map.height * 8);
+    map_mip_rows = 0;
+    map_view.zoom = 0.0f;
+}
+
+
+/*
+ * Add a sprite's pattern (or pattern pair) from a replaced tile store to the current one.
+ */
+uint16_t sprite_pattern_carry (const Tile_Store *from, uint16_t pattern, bool tall)
+{
+    if (tall)
+    {
+        uint32_t top = pattern & ~1u;
+        if (top + 1 >= from->tiles.size ())
+        {
+            return pattern;
+        }
+        return tile_store_add_pair (&tile_store, &from->tiles [top], &from->tiles [top + 1]) | (pattern & 1);
+    }
+
+    if (pattern >= from->tiles.size ())
+    {
+        return pattern;
+    }
+    return tile_store_add (&tile_store, &from->tiles [pattern], tile_hash (from->tiles [pattern].pixel));
+}
+
+
+/*
+ * After the tile store has been replaced, add the tiles used by the metasprite,
+ * the animation and the VDP preview's sprites back into it, and point the
+ * sprites at their new indices.
+ */
+void sprite_tiles_carry (const Tile_Store *from)
+{
+    for (Metasprite_Entry &entry : metasprite.entries)
+    {
+        entry.pattern = sprite_pattern_carry (from, entry.pattern, metasprite.tall);
+    }
+
+    for (Animation_Frame &frame : animation.frames)
+    {
+        for (Metasprite_Entry &entry : frame.sprite.entries)
+        {
+            entry.pattern = sprite_pattern_carry (from, entry.pattern, frame.sprite.tall);
+        }
+    }
+    animation_stream (&animation);
+
+    for (Vdp_Sprite &sprite : vdp_scene.sprites)
+    {
+        sprite.pattern = sprite_pattern_carry (from, sprite.pattern, sprite_8x16);
+    }
+}
+
+
+/*
+ * Start a VRAM plan holding just the tileset.
+ */
+void vram_layout_init (Vram_Plan *plan)
+{
+    Vram_Item tileset_item = { "Tileset", 0, false, false, 0 };
+
+    vram_plan_init (plan);
+    plan->items.push_back (tileset_item);
+}
+
+
+/*
+ * Exchange the active document's state with a stored one.
+ */
+void document_swap (Document_State *state)
+{
+    std::swap (palette, state->palette);
+    std::swap (tile_count, state->tile_count);
+    std::swap (tile, state->tile);
+    std::swap (canvas_view, state->canvas_view);
+    std::swap (canvas_fit, state->canvas_fit);
+    std::swap (tile_store, state->tile_store);
+    std::swap (tile_map, state->tile_map);
+    std::swap (reduce_undo_available, state->reduce_undo_available);
+    std::swap (reduce_undo_store, state->reduce_undo_store);
+    std::swap (reduce_undo_map, state->reduce_undo_map);
+    std::swap (tile_atlas, state->tile_atlas);
+    std::swap (map_mip, state->map_mip);
+    std::swap (map_mip_rows, state->map_mip_rows);
+    std::swap (map_view, state->map_view);
+    std::swap (sprite_8x16, state->sprite_8x16);
+    std::swap (vram_layout, state->vram_layout);
+    std::swap (vdp_scene, state->vdp_scene);
+    std::swap (metasprite, state->metasprite);
+    std::swap (metasprite_canvas, state->metasprite_canvas);
+    std::swap (animation, state->animation);
+}
+
+
+/*
+ * True while a background job will write its result into the active document.
+ */
+bool document_busy (void)
+{
+    return import_job != NULL || reduce_job != NULL || palette_job != NULL;
+}
+
+
+/*
+ * Make another document active. The state is exchanged rather than copied,
+ * so each document keeps its own textures and switching rebuilds nothing.
+ */
+void document_select (uint32_t index)
+{
+    if (index == document_active || index >= documents.size ())
+    {
+        return;
+    }
+
+    document_swap (&documents [document_active]->state);
+    document_swap (&documents [index]->state);
+    document_active = index;
+}
+
+
+/*
+ * Add the first document, holding the current state.
+ */
+void document_init (void)
+{
+    Document *document = new Document ();
+
+    snprintf (document->name, sizeof (document->name), "Untitled");
+    document->id = document_next_id++;
+
+    documents.push_back (document);
+    document_active = 0;
+}
+
+
+/*
+ * Open a new document, either blank with the current palette, or a copy of
+ * the active document. A copy shares its tiles with the original until either
+ * changes them. Each document has its own tile atlas and mip chain, so that
+ * switching rebuilds nothing; neither takes any memory until the document's
+ * tiles or map are first drawn.
+ */
+void document_new (bool copy)
+{
+    Document *document = new Document ();
+    Document_State *state = &document->state;
+
+    document->id = document_next_id++;
+
+    memcpy (state->palette, palette, sizeof (palette));
+    if (copy)
+    {
+        snprintf (document->name, sizeof (document->name), "%.58s copy", documents [document_active]->name);
+        state->tile_count = tile_count;
+        memcpy (state->tile, tile, sizeof (tile));
+        state->canvas_view = canvas_view;
+        state->canvas_fit = canvas_fit;
+        state->tile_store = tile_store;
+        state->tile_map = tile_map;
+        state->sprite_8x16 = sprite_8x16;
+        state->vram_layout = vram_layout;
+        state->vdp_scene = vdp_scene;
+        state->metasprite = metasprite;
+        memcpy (state->metasprite_canvas, metasprite_canvas, sizeof (metasprite_canvas));
+        state->animation = animation;
+    }
+    else
+    {
+        snprintf (document->name, sizeof (document->name), "Untitled %u", document->id);
+        state->tile_count = 1;
+        vram_layout_init (&state->vram_layout);
+    }
+    tile_atlas_init (&state->tile_atlas, renderer_headless);
+    mip_init (&state->map_mip, renderer_headless);
+
+    documents.push_back (document);
+    document_select (documents.size () - 1);
+    map_view_reset ();
+}
+
+
+/*
+ * Close a document, first switching away from it if it is active.
+ * The last document stays open.
+ */
+void document_close (uint32_t index)
+{
+    if (index >= documents.size () || documents.size () == 1)
+    {
+        return;
+    }
+
+    if (index == document_active)
+    {
+        document_select (index > 0 ? index - 1 : 1);
+    }
+
+    Document *document = documents [index];
+    tile_atlas_free (&document->state.tile_atlas);
+    mip_free (&document->state.map_mip);
+    delete document;
+
+    documents.erase (documents.begin () + index);
+    if (document_active > index)
+    {
+        document_active--;
+    }
+}
+
+
+/*
+ * Close every document, keeping the active document's state in the globals.
+ */
+void document_free_all (void)
+{
+    for (uint32_t i = 0; i < documents.size (); i++)
+    {
+        if (i != document_active)
+        {
+            tile_atlas_free (&documents [i]->state.tile_atlas);
+            mip_free (&documents [i]->state.map_mip);
+        }
+        delete documents [i];
+    }
+
+    documents.clear ();
+    document_active = 0;
+}
+
+
+/*
+ * Serialise the active document for the autosave journal.
+ */
+void project_snapshot_document (std::vector<uint8_t> *buffer)
+{
+    buffer->push_back (tile_count);
+    buffer->insert (buffer->end (), palette, palette + sizeof (palette));
+    buffer->insert (buffer->end (), tile, tile + sizeof (tile));
+}
+
+
+/*
+ * Serialise the active document's metasprite for the autosave journal.
+ */
+void project_snapshot_metasprite (std::vector<uint8_t> *buffer)
+{
+    buffer->insert (buffer->end (), metasprite_canvas, metasprite_canvas + sizeof (metasprite_canvas));
+    buffer->push_back (metasprite.origin_x);
+    buffer->push_back (metasprite.origin_y);
+    buffer->push_back (metasprite.tall);
+    buffer->push_back (metasprite.entries.size () & 0xff);
+    buffer->push_back (metasprite.entries.size () >> 8);
+
+    for (const Metasprite_Entry &entry : metasprite.entries)
+    {
+        buffer->push_back (entry.x & 0xff);
+        buffer->push_back ((uint16_t) entry.x >> 8);
+        buffer->push_back (entry.y & 0xff);
+        buffer->push_back ((uint16_t) entry.y >> 8);
+        buffer->push_back (entry.pattern & 0xff);
+        buffer->push_back (entry.pattern >> 8);
+    }
+}
+
+
+/*
+ * Serialise every document for the autosave journal. The stored documents are
+ * swapped into the globals in turn, so that each is written by the same code.
+ */
+void project_snapshot (std::vector<uint8_t> *buffer)
+{
+    buffer->clear ();
+    buffer->push_back (documents.size () & 0xff);
+    buffer->push_back (documents.size () >> 8);
+    buffer->push_back (document_active & 0xff);
+    buffer->push_back (document_active >> 8);
+
+    for (uint32_t i = 0; i < documents.size (); i++)
+    {
+        Document *document = documents [i];
+        buffer->insert (buffer->end (), document->name, document->name + PROJECT_NAME_SIZE);
+
+        if (i != document_active)
+        {
+            document_swap (&document->state);
+        }
+
+        project_snapshot_document (buffer);
+        project_snapshot_metasprite (buffer);
+
+        if (i != document_active)
+        {
+            document_swap (&document->state);
+        }
+    }
+}
+
+
+/*
+ * Restore the active document from an autosave snapshot.
+ */
+void project_restore_document (const uint8_t *buffer)
+{
+    tile_count = (buffer [0] == 2) ? 2 : 1;
+    memcpy (palette, &buffer [1], sizeof (palette));
+    memcpy (tile, &buffer [1 + sizeof (palette)], sizeof (tile));
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        palette [i] &= 0x3f;
+    }
+    for (uint32_t i = 0; i < sizeof (tile); i++)
+    {
+        tile [i] &= 0x0f;
+    }
+}
+
+
+/*
+ * Restore the active document's metasprite from an autosave snapshot.
+ * Returns the number of bytes read, or zero if the snapshot is too short.
+ */
+uint32_t project_restore_metasprite (const uint8_t *buffer, uint32_t size)
+{
+    if (size < PROJECT_METASPRITE_SIZE)
+    {
+        return 0;
+    }
+
+    const uint8_t *header = &buffer [sizeof (metasprite_canvas)];
+    uint32_t count = std::min (header [3] | (header [4] << 8), PROJECT_METASPRITE_ENTRIES_MAX);
+    if (size < PROJECT_METASPRITE_SIZE + count * 6)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < sizeof (metasprite_canvas); i++)
+    {
+        metasprite_canvas [i] = buffer [i] & 0x0f;
+    }
+    metasprite.origin_x = std::min (header [0], (uint8_t) METASPRITE_CANVAS_MAX);
+    metasprite.origin_y = std::min (header [1], (uint8_t) METASPRITE_CANVAS_MAX);
+    metasprite.tall = header [2] != 0;
+
+    const uint8_t *entry = &buffer [PROJECT_METASPRITE_SIZE];
+    metasprite.entries.resize (count);
+    for (uint32_t i = 0; i < count; i++, entry += 6)
+    {
+        metasprite.entries [i].x = (int16_t) (entry [0] | (entry [1] << 8));
+        metasprite.entries [i].y = (int16_t) (entry [2] | (entry [3] << 8));
+        metasprite.entries [i].pattern = entry [4] | (entry [5] << 8);
+    }
+
+    return PROJECT_METASPRITE_SIZE + count * 6;
+}
+
+
+/*
+ * Restore every document from an autosave snapshot, replacing the single
+ * document open at startup. Project files before version 3 held just one
+ * document, without its name or metasprite.
+ */
+void project_restore (const std::vector<uint8_t> &snapshot, uint32_t version)
+{
+    if (version < 3)
+    {
+        if (snapshot.size () == PROJECT_DOCUMENT_SIZE)
+        {
+            project_restore_document (snapshot.data ());
+        }
+        return;
+    }
+
+    uint32_t count = 0;
+    uint32_t active = 0;
+    if (snapshot.size () >= PROJECT_HEADER_SIZE)
+    {
+        count = snapshot [0] | (snapshot [1] << 8);
+        active = snapshot [2] | (snapshot [3] << 8);
+    }
+
+    /* Documents are restored in order, so a damaged snapshot keeps those before the damage */
+    uint32_t offset = PROJECT_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (snapshot.size () < offset + PROJECT_NAME_SIZE + PROJECT_DOCUMENT_SIZE)
+        {
+            fprintf (stderr, "The autosaved project is damaged, recovering %u of %u documents.\n", i, count);
+            break;
+        }
+
+        if (i > 0)
+        {
+            document_new (false);
+        }
+
+        Document *document = documents [document_active];
+        memcpy (document->name, &snapshot [offset], PROJECT_NAME_SIZE);
+        document->name [PROJECT_NAME_SIZE - 1] = '\0';
+        project_restore_document (&snapshot [offset + PROJECT_NAME_SIZE]);
+        offset += PROJECT_NAME_SIZE + PROJECT_DOCUMENT_SIZE;
+
+        uint32_t size = project_restore_metasprite (snapshot.data () + offset, snapshot.size () - offset);
+        if (size == 0)
+        {
+            fprintf (stderr, "The autosaved project is damaged, recovering %u of %u documents.\n", i + 1, count);
+            break;
+        }
+        offset += size;
+    }
+
+    document_select (std::min (active, (uint32_t) documents.size () - 1));
+    journal_document = document_active;
+}
+
+
+/*
+ * Apply an edit from the autosave journal.
+ */
+void project_apply_edit (const Journal_Record *record)
+{
+    switch (record->type)
+    {
+        case JOURNAL_PIXEL:
+            if (record->index < sizeof (tile))
+            {
+                tile [record->index] = record->value & 0x0f;
+            }
+            break;
+
+        case JOURNAL_TILE_COUNT:
+            tile_count = (record->value == 2) ? 2 : 1;
+            break;
+
+        case JOURNAL_PALETTE:
+            if (record->index < 16)
+            {
+                palette [record->index] = record->value & 0x3f;
+            }
+            break;
+
+        case JOURNAL_DOCUMENT:
+            document_select (record->index);
+            break;
+
+        case JOURNAL_METASPRITE_PIXEL:
+            if (record->index < sizeof (metasprite_canvas))
+            {
+                metasprite_canvas [record->index] = record->value & 0x0f;
+            }
+            break;
+
+        case JOURNAL_METASPRITE_CLEAR:
+            memset (metasprite_canvas, 0, sizeof (metasprite_canvas));
+            break;
+
+        case JOURNAL_METASPRITE_ORIGIN:
+            if (record->index < 2)
+            {
+                int16_t origin = std::min (record->value, (uint8_t) METASPRITE_CANVAS_MAX);
+
+                /* Entries are stored relative to the origin, keep them in place on the canvas */
+                for (Metasprite_Entry &entry : metasprite.entries)
+                {
+                    if (record->index == 0)
+                    {
+                        entry.x += metasprite.origin_x - origin;
+                    }
+                    else
+                    {
+                        entry.y += metasprite.origin_y - origin;
+                    }
+                }
+
+                if (record->index == 0)
+                {
+                    metasprite.origin_x = origin;
+                }
+                else
+                {
+                    metasprite.origin_y = origin;
+                }
+            }
+            break;
+
+        case JOURNAL_METASPRITE_COUNT:
+            metasprite.entries.resize (std::min ((uint32_t) record->index, (uint32_t) PROJECT_METASPRITE_ENTRIES_MAX));
+            metasprite.tall = record->value != 0;
+            break;
+
+        case JOURNAL_METASPRITE_REMOVE:
+            if (record->index < metasprite.entries.size ())
+            {
+                metasprite.entries.erase (metasprite.entries.begin () + record->index);
+            }
+            break;
+
+        case JOURNAL_METASPRITE_ENTRY:
+        {
+            uint32_t index = record->index & JOURNAL_ENTRY_INDEX_MASK;
+            if (index >= metasprite.entries.size ())
+            {
+                break;
+            }
+
+            Metasprite_Entry *entry = &metasprite.entries [index];
+            switch (record->index >> JOURNAL_ENTRY_FIELD_SHIFT)
+            {
+                case JOURNAL_ENTRY_X:
+                    entry->x = (int8_t) record->value;
+                    break;
+                case JOURNAL_ENTRY_Y:
+                    entry->y = (int8_t) record->value;
+                    break;
+                case JOURNAL_ENTRY_PATTERN_LOW:
+                    entry->pattern = (entry->pattern & 0xff00) | record->value;
+                    break;
+                case JOURNAL_ENTRY_PATTERN_HIGH:
+                    entry->pattern = (entry->pattern & 0x00ff) | (record->value << 8);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+
+/*
+ * Make an edit to the active document, recording it in the autosave journal.
+ * A document record first marks which document the edit belongs to, when
+ * that has changed since the last edit.
+ */
+void project_edit (uint8_t type, uint16_t index, uint8_t value)
+{
+    Journal_Record record = { type, value, index };
+
+    project_apply_edit (&record);
+
+    if (journal_document != document_active)
+    {
+        journal_append (JOURNAL_DOCUMENT, document_active, 0);
+        journal_document = document_active;
+    }
+
+    journal_append (type, index, value);
+    autosave_dirty = true;
+}
+
+
+/*
+ * Set every field of a metasprite entry, recording each in the autosave journal.
+ */
+void project_edit_metasprite_entry (uint32_t index, const Metasprite_Entry *entry)
+{
+    project_edit (JOURNAL_METASPRITE_ENTRY, index | (JOURNAL_ENTRY_X << JOURNAL_ENTRY_FIELD_SHIFT), entry->x);
+    project_edit (JOURNAL_METASPRITE_ENTRY, index | (JOURNAL_ENTRY_Y << JOURNAL_ENTRY_FIELD_SHIFT), entry->y);
+    project_edit (JOURNAL_METASPRITE_ENTRY, index | (JOURNAL_ENTRY_PATTERN_LOW << JOURNAL_ENTRY_FIELD_SHIFT),
+                  entry->pattern & 0xff);
+    project_edit (JOURNAL_METASPRITE_ENTRY, index | (JOURNAL_ENTRY_PATTERN_HIGH << JOURNAL_ENTRY_FIELD_SHIFT),
+                  entry->pattern >> 8);
+}
+
+
+/*
+ * Write the project file and truncate the journal, if anything has changed.
+ * The write itself happens on the journal's background thread.
+ */
+void project_autosave (void)
+{
+    std::vector<uint8_t> snapshot;
+
+    if (!autosave_dirty)
+    {
+        return;
+    }
+
+    project_snapshot (&snapshot);
+    journal_compact (snapshot.data (), snapshot.size ());
+    journal_document = document_active;
+    autosave_dirty = false;
+}
+
+
+/*
+ * Save every document after one is opened or closed, as the journal's
+ * records refer to documents by their position.
+ */
+void project_documents_changed (void)
+{
+    autosave_dirty = true;
+    project_autosave ();
+}
+
+
+/*
+ * Called on the UI thread when an import job finishes.
+ */
+void import_complete (Job *job)
+{
+    Import_Context *context = (Import_Context *) job->data;
+
+    if (context->success)
+    {
+        std::swap (tile_store, context->store);
+        std::swap (tile_map, context->map);
+        sprite_tiles_carry (&context->store);
+        tile_atlas_invalidate (&tile_atlas);
+        map_view_reset ();
+        reduce_undo_available = false;
+        snprintf (import_status, sizeof (import_status), "Imported %u × %u tiles, %u unique.",
+                  tile_map.width, tile_map.height, (uint32_t) tile_store.tiles.size ());
+
+        if (context->optimise_palette)
+        {
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                if (palette [i] != context->palette [i])
+                {
+                    project_edit (JOURNAL_PALETTE, i, context->palette [i]);
+                }
+            }
+            snprintf (import_status + strlen (import_status), sizeof (import_status) - strlen (import_status),
+                      " Palette error %.1f ΔE.", sqrtf (context->palette_error));
+        }
+    }
+    else
+    {
+        snprintf (import_status, sizeof (import_status), "Import failed: %s.", context->error.c_str ());
+    }
+
+    delete context;
+    import_job = NULL;
+}
+
+
+/*
+ * Called from jobs_shutdown () if an import is still running at exit.
+ */
+void import_discard (Job *job)
+{
+    delete (Import_Context *) job->data;
+    import_job = NULL;
+}
+
+
+/*
+ * Import dialog.
+ */
+void import_dialog (void)
+{
+    if (import_dialog_open)
+    {
+        ImGui::OpenPopup ("Import Image");
+        import_dialog_open = false;
+    }
+
+    if (ImGui::BeginPopupModal ("Import Image", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        ImGui::Text ("Binary PPM (P6) image, quantised to the current palette.");
+        ImGui::SetNextItemWidth (400.0f);
+        ImGui::InputText ("Path", import_path, sizeof (import_path));
+        ImGui::Checkbox ("Choose palette for this image", &import_optimise_palette);
+        ImGui::Checkbox ("Index 0 is transparent", &palette_transparent);
+        ImGui::SetNextItemWidth (200.0f);
+        ImGui::Combo ("Dithering", &import_dither, dither_mode_names, DITHER_MODE_COUNT);
+
+        if (import_job != NULL)
+        {
+            ImGui::ProgressBar (job_progress (import_job), ImVec2 (400.0f, 0.0f));
+        }
+        else if (import_status [0] != '\0')
+        {
+            ImGui::Text ("%s", import_status);
+        }
+
+        if (ImGui::Button ("Import") && import_job == NULL && reduce_job == NULL && import_path [0] != '\0')
+        {
+            Import_Context *context = new Import_Context;
+            context->path = import_path;
+            context->optimise_palette = import_optimise_palette;
+            context->dither = (Dither_Mode) import_dither;
+            context->transparent = palette_transparent;
+            memcpy (context->palette, palette, sizeof (palette));
+            import_job = job_submit ("Import", import_run, import_complete, import_discard, context);
+        }
+
+        ImGui::SameLine ();
+        if (ImGui::Button ("Close"))
+        {
+            ImGui::CloseCurrentPopup ();
+        }
+
+        ImGui::EndPopup ();
+    }
+}
+
+/*
+ * Called on the UI thread when a tile count reduction finishes.
+ */
+void tile_reduce_complete (Job *job)
+{
+    Reduce_Context *context = (Reduce_Context *) job->data;
+
+    if (context->success)
+    {
+        std::swap (reduce_undo_store, tile_store);
+        std::swap (reduce_undo_map, tile_map);
+        std::swap (tile_store, context->store);
+        std::swap (tile_map, context->map);
+        sprite_tiles_carry (&reduce_undo_store);
+        tile_atlas_invalidate (&tile_atlas);
+        map_view_reset ();
+        reduce_undo_available = true;
+
+        snprintf (reduce_status, sizeof (reduce_status), "%u → %u tiles, %llu pixels changed (%.2f%%).",
+                  context->tiles_before, (uint32_t) tile_store.tiles.size (),
+                  (unsigned long long) context->pixels_changed,
+                  context->pixels_total ? 100.0 * context->pixels_changed / context->pixels_total : 0.0);
+    }
+    else
+    {
+        snprintf (reduce_status, sizeof (reduce_status), "Reduction failed: %s.", context->error.c_str ());
+    }
+
+    delete context;
+    reduce_job = NULL;
+}
+
+
+/*
+ * Called from jobs_shutdown () if a tile count reduction is still running at exit.
+ */
+void tile_reduce_discard (Job *job)
+{
+    delete (Reduce_Context *) job->data;
+    reduce_job = NULL;
+}
+
+
+/*
+ * Tile count reduction dialog.
+ */
+void tile_reduce_dialog (void)
+{
+    if (reduce_dialog_open)
+    {
+        ImGui::OpenPopup ("Reduce Tile Count");
+        reduce_dialog_open = false;
+    }
+
+    if (ImGui::BeginPopupModal ("Reduce Tile Count", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        ImGui::Text ("Merge similar tiles (including flipped tiles) until the budget is met.");
+        ImGui::Text ("Current tile count: %u", (uint32_t) tile_store.tiles.size ());
+        ImGui::SetNextItemWidth (120.0f);
+        ImGui::InputInt ("Tile budget", &reduce_budget);
+        reduce_budget = (reduce_budget < 1) ? 1 : reduce_budget;
+
+        if (reduce_job != NULL)
+        {
+            ImGui::ProgressBar (job_progress (reduce_job), ImVec2 (400.0f, 0.0f));
+        }
+        else if (reduce_status [0] != '\0')
+        {
+            ImGui::Text ("%s", reduce_status);
+        }
+
+        if (ImGui::Button ("Reduce") && reduce_job == NULL && import_job == NULL)
+        {
+            Reduce_Context *context = new Reduce_Context;
+            context->store = tile_store;
+            context->map = tile_map;
+            context->budget = reduce_budget;
+            reduce_job = job_submit ("Reduce", tile_reduce_run, tile_reduce_complete, tile_reduce_discard, context);
+        }
+
+        ImGui::SameLine ();
+        if (ImGui::Button ("Revert") && reduce_undo_available && reduce_job == NULL)
+        {
+            std::swap (tile_store, reduce_undo_store);
+            std::swap (tile_map, reduce_undo_map);
+            sprite_tiles_carry (&reduce_undo_store);
+            tile_atlas_invalidate (&tile_atlas);
+            map_view_reset ();
+            reduce_undo_available = false;
+            reduce_status [0] = '\0';
+        }
+
+        ImGui::SameLine ();
+        if (ImGui::Button ("Close"))
+        {
+            ImGui::CloseCurrentPopup ();
+        }
+
+        ImGui::EndPopup ();
+    }
+}
+
+
+/*
+ * Called on the UI thread when a shared palette optimisation finishes.
+ */
+void palette_optimise_complete (Job *job)
+{
+    Palette_Context *context = (Palette_Context *) job->data;
+
+    if (context->success)
+    {
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            if (palette [i] != context->palette [i])
+            {
+                project_edit (JOURNAL_PALETTE, i, context->palette [i]);
+            }
+        }
+        snprintf (palette_status, sizeof (palette_status), "Palette chosen for %u images, error %.1f ΔE.",
+                  (uint32_t) context->paths.size (), sqrtf (context->palette_error));
+    }
+    else
+    {
+        snprintf (palette_status, sizeof (palette_status), "Optimisation failed: %s.", context->error.c_str ());
+    }
+
+    delete context;
+    palette_job = NULL;
+}
+
+
+/*
+ * Called from jobs_shutdown () if a shared palette optimisation is still running at exit.
+ */
+void palette_optimise_discard (Job *job)
+{
+    delete (Palette_Context *) job->data;
+    palette_job = NULL;
+}
+
+
+/*
+ * Shared palette dialog: choose one palette for a set of images.
+ */
+void palette_dialog (void)
+{
+    if (palette_dialog_open)
+    {
+        ImGui::OpenPopup ("Shared Palette");
+        palette_dialog_open = false;
+    }
+
+    if (ImGui::BeginPopupModal ("Shared Palette", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        ImGui::Text ("Binary PPM (P6) images, one path per line.");
+        ImGui::InputTextMultiline ("##paths", palette_paths, sizeof (palette_paths), ImVec2 (400.0f, 120.0f));
+
+        ImGui::Checkbox ("Index 0 is transparent", &palette_transparent);
+        ImGui::Text ("Locked entries:");
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            ImGui::PushID (i);
+            ImGui::ColorButton ("##colour", sms_to_imgui_colour (palette [i], 0), ImGuiColorEditFlags_NoTooltip);
+            ImGui::SameLine (0.0f, 2.0f);
+            ImGui::Checkbox (palette_strings [i], &palette_locked [i]);
+            ImGui::PopID ();
+
+            if (i % 8 != 7)
+            {
+                ImGui::SameLine ();
+            }
+        }
+
+        if (palette_job != NULL)
+        {
+            ImGui::ProgressBar (job_progress (palette_job), ImVec2 (400.0f, 0.0f));
+        }
+        else if (palette_status [0] != '\0')
+        {
+            ImGui::Text ("%s", palette_status);
+        }
+
+        if (ImGui::Button ("Optimise") && palette_job == NULL)
+        {
+            Palette_Context *context = new Palette_Context;
+            const char *line = palette_paths;
+
+            while (*line != '\0')
+            {
+                const char *end = strchr (line, '\n');
+                std::string path = (end != NULL) ? std::string (line, end) : std::string (line);
+
+                if (!path.empty ())
+                {
+                    context->paths.push_back (path);
+                }
+                line = (end != NULL) ? end + 1 : line + strlen (line);
+            }
+
+            memcpy (context->palette, palette, sizeof (palette));
+            context->locked = 0;
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                context->locked |= palette_locked [i] ? (1 << i) : 0;
+            }
+            context->transparent = palette_transparent;
+
+            palette_job = job_submit ("Palette", palette_optimise_run, palette_optimise_complete,
+                                     palette_optimise_discard, context);
+        }
+
+        ImGui::SameLine ();
+        if (ImGui::Button ("Close"))
+        {
+            ImGui::CloseCurrentPopup ();
+        }
+
+        ImGui::EndPopup ();
+    }
+}
+
+
+/*
+ * VRAM planner window.
+ */
+void vram_window (void)
+{
+    if (!vram_window_open)
+    {
+        return;
+    }
+
+    /* The imported tileset is always the first item */
+    vram_layout.items [0].tiles = tile_store.tiles.size ();
+    vram_layout.sprites_tall = sprite_8x16;
+    vram_plan (&vram_layout);
+
+    ImGui::SetNextWindowSize (ImVec2 (560, 520), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin ("VRAM Planner", &vram_window_open))
+    {
+        ImGui::End ();
+        return;
+    }
+
+    /* Usage map, 32 slots per row */
+    float cell = 16.0f;
+    ImDrawList *draw_list = ImGui::GetWindowDrawList ();
+    ImVec2 origin = ImGui::GetCursorScreenPos ();
+    ImGui::InvisibleButton ("usage_map", ImVec2 (32 * cell, 16 * cell));
+
+    for (uint32_t slot = 0; slot < VRAM_SLOTS; slot++)
+    {
+        int16_t owner = vram_layout.owner [slot];
+        ImVec2 min = ImVec2 (origin.x + (slot % 32) * cell, origin.y + (slot / 32) * cell);
+        ImVec2 max = ImVec2 (min.x + cell - 1, min.y + cell - 1);
+        ImU32 colour = (owner == VRAM_FREE)       ? IM_COL32 (40, 40, 40, 255) :
+                       (owner == VRAM_NAME_TABLE) ? IM_COL32 (90, 90, 160, 255) :
+                       (owner == VRAM_SAT)        ? IM_COL32 (160, 90, 90, 255) :
+                                                    (ImU32) ImColor::HSV (owner * 0.13f, 0.6f, 0.8f);
+        draw_list->AddRectFilled (min, max, colour);
+    }
+
+    if (ImGui::IsItemHovered ())
+    {
+        ImVec2 mouse = ImGui::GetIO ().MousePos;
+        uint32_t slot = (uint32_t) ((mouse.y - origin.y) / cell) * 32 + (uint32_t) ((mouse.x - origin.x) / cell);
+        if (slot < VRAM_SLOTS)
+        {
+            int16_t owner = vram_layout.owner [slot];
+            ImGui::SetTooltip ("Slot %u ($%04x): %s", slot, slot * VRAM_SLOT_SIZE,
+                               (owner == VRAM_FREE)       ? "Free" :
+                               (owner == VRAM_NAME_TABLE) ? "Name table" :
+                               (owner == VRAM_SAT)        ? "Sprite attribute table" :
+                                                            vram_layout.items [owner].name.c_str ());
+        }
+    }
+
+    ImGui::Text ("Free: %u tiles in %u runs, largest %u (fragmentation %.0f%%)",
+                 vram_layout.free_slots, vram_layout.free_runs, vram_layout.largest_free,
+                 vram_layout.free_slots ? 100.0f * (1.0f - (float) vram_layout.largest_free / vram_layout.free_slots) : 0.0f);
+    ImGui::Checkbox ("Sprite patterns at $2000", &vram_layout.sprites_high);
+
+    /* Items */
+    ImGui::Separator ();
+    ImGui::Columns (4);
+    for (uint32_t i = 0; i < vram_layout.items.size (); i++)
+    {
+        Vram_Item *item = &vram_layout.items [i];
+
+        ImGui::PushID (i);
+        ImGui::ColorButton ("##colour", ImColor::HSV (i * 0.13f, 0.6f, 0.8f), ImGuiColorEditFlags_NoTooltip);
+        ImGui::SameLine ();
+        ImGui::Text ("%s", item->name.c_str ());
+        ImGui::NextColumn ();
+        ImGui::Text ("%u tiles%s", item->tiles, item->sprite ? ", sprite" : "");
+        ImGui::NextColumn ();
+        if (item->placed)
+        {
+            ImGui::Text ("$%04x", item->base * VRAM_SLOT_SIZE);
+        }
+        else
+        {
+            ImGui::TextColored (ImVec4 (1.0f, 0.4f, 0.4f, 1.0f), item->tiles ? "Does not fit" : "Empty");
+        }
+        ImGui::NextColumn ();
+        if (i > 0 && ImGui::SmallButton ("Remove"))
+        {
+            vram_layout.items.erase (vram_layout.items.begin () + i);
+        }
+        ImGui::NextColumn ();
+        ImGui::PopID ();
+    }
+    ImGui::Columns (1);
+
+    ImGui::Separator ();
+    ImGui::SetNextItemWidth (120.0f);
+    ImGui::InputText ("Name", vram_new_name, sizeof (vram_new_name));
+    ImGui::SameLine ();
+    ImGui::SetNextItemWidth (80.0f);
+    ImGui::InputInt ("Tiles", &vram_new_tiles);
+    vram_new_tiles = (vram_new_tiles < 1) ? 1 : (vram_new_tiles > VRAM_SLOTS) ? VRAM_SLOTS : vram_new_tiles;
+    ImGui::SameLine ();
+    ImGui::Checkbox ("Sprite", &vram_new_sprite);
+    ImGui::SameLine ();
+    if (ImGui::Button ("Add") && vram_new_name [0] != '\0')
+    {
+        Vram_Item item = { vram_new_name, (uint32_t) vram_new_tiles, vram_new_sprite, false, 0 };
+        vram_layout.items.push_back (item);
+        vram_new_name [0] = '\0';
+    }
+
+    if (ImGui::Button ("Export Constants"))
+    {
+        vram_export (&vram_layout);
+    }
+
+    ImGui::End ();
+}
+
+
+/*
+ * VDP preview window.
+ */
+void vdp_window (void)
+{
+    if (!vdp_window_open)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowSize (ImVec2 (640, 560), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin ("VDP Preview", &vdp_window_open))
+    {
+        ImGui::End ();
+        return;
+    }
+
+    /* Scroll position within the map */
+    int map_x = vdp_scene.map_x;
+    int map_y = vdp_scene.map_y;
+    int max_x = (tile_map.width > VDP_WIDTH / 8) ? tile_map.width - VDP_WIDTH / 8 : 0;
+    int max_y = (tile_map.height > VDP_HEIGHT / 8) ? tile_map.height - VDP_HEIGHT / 8 : 0;
+    ImGui::SetNextItemWidth (200.0f);
+    ImGui::SliderInt ("Map X", &map_x, 0, max_x);
+    ImGui::SameLine ();
+    ImGui::SetNextItemWidth (200.0f);
+    ImGui::SliderInt ("Map Y", &map_y, 0, max_y);
+    vdp_scene.map_x = std::min (map_x, max_x);
+    vdp_scene.map_y = std::min (map_y, max_y);
+
+    ImGui::SetNextItemWidth (100.0f);
+    ImGui::SliderInt ("Zoom", &vdp_zoom, 1, 4);
+    ImGui::SameLine ();
+    ImGui::Checkbox ("Sprites per line", &vdp_heat_map);
+
+    /* Render */
+    vdp_scene.store = &tile_store;
+    vdp_scene.map = &tile_map;
+    vdp_scene.palette = palette;
+    vdp_scene.tall_sprites = sprite_8x16;
+
+    uint64_t start = SDL_GetPerformanceCounter ();
+    vdp_render (&vdp_scene, vdp_pixels, vdp_line_sprites);
+    float render_ms = (SDL_GetPerformanceCounter () - start) * 1000.0f / SDL_GetPerformanceFrequency ();
+
+    glBindTexture (GL_TEXTURE_2D, vdp_texture);
+    glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, VDP_WIDTH, VDP_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, vdp_pixels);
+    hud_texture_bytes += sizeof (vdp_pixels);
+
+    ImVec2 origin = ImGui::GetCursorScreenPos ();
+    ImGui::Image ((void *) (intptr_t) vdp_texture, ImVec2 (VDP_WIDTH * vdp_zoom, VDP_HEIGHT * vdp_zoom));
+
+    /* Heat map of sprites per line, to the right of the frame */
+    uint32_t overflow_lines = 0;
+    if (vdp_heat_map)
+    {
+        ImDrawList *draw_list = ImGui::GetWindowDrawList ();
+        float left = origin.x + VDP_WIDTH * vdp_zoom + 4.0f;
+
+        for (uint32_t line = 0; line < VDP_HEIGHT; line++)
+        {
+            uint8_t count = vdp_line_sprites [line];
+            float top = origin.y + line * vdp_zoom;
+            ImU32 colour = (count > VDP_SPRITES_PER_LINE) ? IM_COL32 (255, 64, 64, 255) :
+                           (count == VDP_SPRITES_PER_LINE) ? IM_COL32 (255, 200, 64, 255) :
+                                                             IM_COL32 (64, 200, 64, 255);
+            if (count)
+            {
+                draw_list->AddRectFilled (ImVec2 (left, top), ImVec2 (left + count * 4.0f, top + vdp_zoom), colour);
+            }
+        }
+    }
+    for (uint32_t line = 0; line < VDP_HEIGHT; line++)
+    {
+        overflow_lines += vdp_line_sprites [line] > VDP_SPRITES_PER_LINE;
+    }
+
+    ImGui::Text ("Rendered in %.3f ms. %u lines exceed %u sprites.", render_ms, overflow_lines, VDP_SPRITES_PER_LINE);
+
+    /* Sprite table */
+    if (ImGui::CollapsingHeader ("Sprites"))
+    {
+        for (uint32_t i = 0; i < vdp_scene.sprites.size (); i++)
+        {
+            Vdp_Sprite *sprite = &vdp_scene.sprites [i];
+            int values [3] = { sprite->x, sprite->y, sprite->pattern };
+
+            ImGui::PushID (i);
+            ImGui::SetNextItemWidth (240.0f);
+            if (ImGui::DragInt3 ("x, y, pattern", values))
+            {
+                sprite->x = std::min (255, std::max (-8, values [0]));
+                sprite->y = std::min (191, std::max (-16, values [1]));
+                sprite->pattern = std::min (TILE_INDEX_MASK, std::max (0, values [2]));
+            }
+            ImGui::SameLine ();
+            if (ImGui::SmallButton ("Remove"))
+            {
+                vdp_scene.sprites.erase (vdp_scene.sprites.begin () + i);
+            }
+            ImGui::PopID ();
+        }
+
+        if (vdp_scene.sprites.size () < VDP_SPRITES_MAX && ImGui::Button ("Add Sprite"))
+        {
+            Vdp_Sprite sprite = { 120, 88, 0 };
+            vdp_scene.sprites.push_back (sprite);
+        }
+    }
+
+    ImGui::End ();
+}
+
+
+/*
+ * Tileset browser, showing the tile store as a scrolling grid.
+ */
+void tileset_window (void)
+{
+    if (!tileset_window_open)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowSize (ImVec2 (480, 400), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin ("Tileset", &tileset_window_open))
+    {
+        ImGui::End ();
+        return;
+    }
+
+    uint32_t count = tile_store.tiles.size ();
+    ImGui::SetNextItemWidth (100.0f);
+    ImGui::SliderInt ("Zoom", &tileset_zoom, 1, 4);
+    ImGui::SameLine ();
+    ImGui::Text ("%u tiles", count);
+
+    /* Blocks of tiles shared with duplicated documents */
+    uint32_t shared = tile_store.tiles.shared_block_count ();
+    if (shared > 0)
+    {
+        ImGui::SameLine ();
+        ImGui::TextDisabled ("(%u of %u blocks shared)", shared, (uint32_t) tile_store.tiles.block_count ());
+    }
+
+    ImGui::BeginChild ("tiles", ImVec2 (0, 0), true);
+
+    float tile_size = 8.0f * tileset_zoom;
+    float cell_size = tile_size + 2.0f;
+    uint32_t columns = std::max (1.0f, ImGui::GetContentRegionAvail ().x / cell_size);
+    uint32_t rows = (count + columns - 1) / columns;
+
+    /* Only the rows inside the clip rect are submitted, so the cost of a frame
+     * does not depend on the size of the store. Rows are packed with no item
+     * spacing, so that the clipper can place them from their height alone. */
+    ImDrawList *draw_list = ImGui::GetWindowDrawList ();
+    uint32_t hovered = UINT32_MAX;
+    ImGui::PushStyleVar (ImGuiStyleVar_ItemSpacing, ImVec2 (0.0f, 0.0f));
+    ImGuiListClipper clipper (rows, cell_size);
+
+    while (clipper.Step ())
+    {
+        for (uint32_t row = clipper.DisplayStart; row < (uint32_t) clipper.DisplayEnd; row++)
+        {
+            ImVec2 origin = ImGui::GetCursorScreenPos ();
+            uint32_t first = row * columns;
+            uint32_t last = std::min (count, first + columns);
+
+            /* All tiles come from the atlas, so the visible grid is one draw command */
+            for (uint32_t t = first; t < last; t++)
+            {
+                tile_atlas_draw (draw_list, &tile_atlas, &tile_store, t, 0, 0,
+                                 origin.x + (t - first) * cell_size, origin.y, tile_size);
+            }
+
+            ImGui::PushID (row);
+            ImGui::InvisibleButton ("row", ImVec2 (columns * cell_size, cell_size));
+            ImGui::PopID ();
+
+            if (ImGui::IsItemHovered ())
+            {
+                uint32_t t = first + (uint32_t) ((ImGui::GetMousePos ().x - origin.x) / cell_size);
+                hovered = (t < last) ? t : hovered;
+            }
+        }
+    }
+
+    ImGui::PopStyleVar ();
+
+    if (hovered < count)
+    {
+        ImGui::BeginTooltip ();
+        ImGui::Text ("Tile %u", hovered);
+        ImVec2 position = ImGui::GetCursorScreenPos ();
+        tile_atlas_draw (ImGui::GetWindowDrawList (), &tile_atlas, &tile_store, hovered, 0, 0,
+                         position.x, position.y, 64.0f);
+        ImGui::Dummy (ImVec2 (64.0f, 64.0f));
+        ImGui::EndTooltip ();
+    }
+
+    ImGui::EndChild ();
+    ImGui::End ();
+}
+
+
+/*
+ * Zoom a view with the mouse wheel about the cursor, and pan it by dragging
+ * with the middle button. The right button is left to the canvas, which
+ * paints with it. The zoom eases towards its target over a few frames. An
+ * image smaller than the view is centred, and a larger one is kept covering
+ * it.
+ */
+void canvas_view_update (Canvas_View *view, ImVec2 origin, ImVec2 size, ImVec2 image_size, bool hovered,
+                         float zoom_min, float zoom_max)
+{
+    ImGuiIO &io = ImGui::GetIO ();
+
+    if (hovered)
+    {
+        if (io.MouseWheel != 0.0f)
+        {
+            view->zoom_target = std::min (zoom_max, std::max (zoom_min, view->zoom_target * powf (1.25f, io.MouseWheel)));
+            view->anchor = io.MousePos;
+        }
+
+        if (ImGui::IsMouseDragging (ImGuiMouseButton_Middle, 0.0f))
+        {
+            view->pan.x -= io.MouseDelta.x / view->zoom;
+            view->pan.y -= io.MouseDelta.y / view->zoom;
+        }
+    }
+
+    if (view->zoom != view->zoom_target)
+    {
+        float zoom = view->zoom + (view->zoom_target - view->zoom) * std::min (1.0f, io.DeltaTime * 15.0f);
+        if (fabsf (zoom - view->zoom_target) < view->zoom_target * 0.001f)
+        {
+            zoom = view->zoom_target;
+        }
+
+        /* Keep the image under the anchor in place */
+        ImVec2 offset (view->anchor.x - origin.x, view->anchor.y - origin.y);
+        view->pan.x += offset.x / view->zoom - offset.x / zoom;
+        view->pan.y += offset.y / view->zoom - offset.y / zoom;
+        view->zoom = zoom;
+    }
+
+    float spare_x = image_size.x - size.x / view->zoom;
+    float spare_y = image_size.y - size.y / view->zoom;
+    view->pan.x = (spare_x > 0.0f) ? std::min (spare_x, std::max (0.0f, view->pan.x)) : spare_x / 2.0f;
+    view->pan.y = (spare_y > 0.0f) ? std::min (spare_y, std::max (0.0f, view->pan.y)) : spare_y / 2.0f;
+}
+
+
+/*
+ * Tile map view. When zoomed in, the visible tiles are drawn from the tile
+ * atlas. When zoomed out, a level of the map's mip chain is drawn instead, so
+ * the cost of a frame stays small however large the map is.
+ */
+void map_window (void)
+{
+    if (!map_window_open)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowSize (ImVec2 (640, 480), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin ("Tile Map", &map_window_open))
+    {
+        ImGui::End ();
+        return;
+    }
+
+    /* Load the map into the mip chain a few rows at a time */
+    if (map_mip_rows < tile_map.height)
+    {
+        uint32_t rows = std::max (1u, MAP_LOAD_PIXELS_PER_FRAME / (tile_map.width * 64));
+        mip_load_map_rows (&map_mip, &tile_map, &tile_store, map_mip_rows, rows);
+        map_mip_rows = std::min (tile_map.height, map_mip_rows + rows);
+    }
+    mip_set_palette (&map_mip, palette);
+
+    ImGui::Text ("%u × %u tiles", tile_map.width, tile_map.height);
+    if (map_mip_rows < tile_map.height)
+    {
+        ImGui::SameLine ();
+        ImGui::Text ("(loading %u%%)", map_mip_rows * 100 / tile_map.height);
+    }
+
+    ImGui::BeginChild ("map", ImVec2 (0, 0), true, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+
+    ImVec2 origin = ImGui::GetCursorScreenPos ();
+    ImVec2 size = ImGui::GetContentRegionAvail ();
+    float map_width = tile_map.width * 8.0f;
+    float map_height = tile_map.height * 8.0f;
+
+    if (size.x < 1.0f || size.y < 1.0f || tile_map.width == 0 || tile_map.height == 0)
+    {
+        ImGui::EndChild ();
+        ImGui::End ();
+        return;
+    }
+
+    /* Start with the whole map in view */
+    float zoom_fit = std::min (size.x / map_width, size.y / map_height);
+    if (map_view.zoom == 0.0f)
+    {
+        map_view.zoom = map_view.zoom_target = zoom_fit;
+        map_view.pan = ImVec2 (0.0f, 0.0f);
+    }
+
+    ImGui::InvisibleButton ("view", size);
+    canvas_view_update (&map_view, origin, size, ImVec2 (map_width, map_height), ImGui::IsItemHovered (),
+                        std::min (zoom_fit, 1.0f), 32.0f);
+
+    ImDrawList *draw_list = ImGui::GetWindowDrawList ();
+    float zoom = map_view.zoom;
+    draw_list->PushClipRect (origin, ImVec2 (origin.x + size.x, origin.y + size.y), true);
+
+    if (zoom >= 1.0f)
+    {
+        /* Only the tiles in view */
+        float tile_size = 8.0f * zoom;
+        int first_column = std::max (0, (int) floorf (map_view.pan.x / 8.0f));
+        int first_row = std::max (0, (int) floorf (map_view.pan.y / 8.0f));
+        int last_column = std::min ((int) tile_map.width, (int) ceilf ((map_view.pan.x + size.x / zoom) / 8.0f));
+        int last_row = std::min ((int) tile_map.height, (int) ceilf ((map_view.pan.y + size.y / zoom) / 8.0f));
+
+        for (int row = first_row; row < last_row; row++)
+        {
+            for (int column = first_column; column < last_column; column++)
+            {
+                uint32_t entry = tile_map.entry [column + row * tile_map.width];
+                tile_atlas_draw (draw_list, &tile_atlas, &tile_store, entry & TILE_INDEX_MASK, 0,
+                                 entry & (TILE_HFLIP | TILE_VFLIP),
+                                 origin.x + (column * 8.0f - map_view.pan.x) * zoom,
+                                 origin.y + (row * 8.0f - map_view.pan.y) * zoom, tile_size);
+            }
+        }
+    }
+    else
+    {
+        /* The level with at least one texel per screen pixel, or the largest that fits in a texture */
+        uint32_t level = std::min (map_mip.levels - 1,
+                                   std::max (mip_first_level (&map_mip), (uint32_t) floorf (log2f (1.0f / zoom))));
+        uint32_t texture = mip_texture (&map_mip, level);
+        float scale = (float) (1u << level) * zoom;
+        ImVec2 p_min (origin.x - map_view.pan.x * zoom, origin.y - map_view.pan.y * zoom);
+
+        draw_list->AddImage ((void *) (intptr_t) texture, p_min,
+                             ImVec2 (p_min.x + map_mip.width [level] * scale, p_min.y + map_mip.height [level] * scale));
+    }
+
+    draw_list->PopClipRect ();
+
+    ImGui::EndChild ();
+    ImGui::End ();
+}
+
+
+/*
+ * Metasprite editor window.
+ */
+void metasprite_window (void)
+{
+    if (!metasprite_window_open)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowSize (ImVec2 (720, 560), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin ("Metasprite Editor", &metasprite_window_open))
+    {
+        ImGui::End ();
+        return;
+    }
+
+    ImGui::SetNextItemWidth (120.0f);
+    ImGui::SliderInt ("Width", &metasprite_width, 8, METASPRITE_CANVAS_MAX);
+    ImGui::SameLine ();
+    ImGui::SetNextItemWidth (120.0f);
+    ImGui::SliderInt ("Height", &metasprite_height, 8, METASPRITE_CANVAS_MAX);
+
+    int origin [2] = { metasprite.origin_x, metasprite.origin_y };
+    ImGui::SetNextItemWidth (120.0f);
+    if (ImGui::DragInt2 ("Origin", origin, 0.25f, 0, METASPRITE_CANVAS_MAX))
+    {
+        origin [0] = std::min (METASPRITE_CANVAS_MAX, std::max (0, origin [0]));
+        origin [1] = std::min (METASPRITE_CANVAS_MAX, std::max (0, origin [1]));
+
+        if (origin [0] != metasprite.origin_x)
+        {
+            project_edit (JOURNAL_METASPRITE_ORIGIN, 0, origin [0]);
+        }
+        if (origin [1] != metasprite.origin_y)
+        {
+            project_edit (JOURNAL_METASPRITE_ORIGIN, 1, origin [1]);
+        }
+    }
+
+    /* Canvas: left button paints with the active colour, right button erases */
+    const float pixel_size = 6.0f;
+    ImVec2 canvas_pos = ImGui::GetCursorScreenPos ();
+    ImGui::InvisibleButton ("canvas", ImVec2 (METASPRITE_CANVAS_MAX * pixel_size + 40.0f,
+                                              METASPRITE_CANVAS_MAX * pixel_size));
+
+    if (ImGui::IsItemHovered ())
+    {
+        ImVec2 mouse = ImGui::GetIO ().MousePos;
+        right_button_used = true;
+        int32_t x = (mouse.x - canvas_pos.x) / pixel_size;
+        int32_t y = (mouse.y - canvas_pos.y) / pixel_size;
+
+        if (x >= 0 && x < metasprite_width && y >= 0 && y < metasprite_height)
+        {
+            uint32_t index = x + y * METASPRITE_CANVAS_MAX;
+
+            if (ImGui::IsMouseDown (ImGuiMouseButton_Left) && metasprite_canvas [index] != active_palette_index)
+            {
+                project_edit (JOURNAL_METASPRITE_PIXEL, index, active_palette_index);
+            }
+            else if (ImGui::IsMouseDown (ImGuiMouseButton_Right) && metasprite_canvas [index] != 0)
+            {
+                project_edit (JOURNAL_METASPRITE_PIXEL, index, 0);
+            }
+        }
+    }
+
+    ImDrawList *draw_list = ImGui::GetWindowDrawList ();
+    draw_list->AddRectFilled (canvas_pos, ImVec2 (canvas_pos.x + metasprite_width * pixel_size,
+                                                  canvas_pos.y + metasprite_height * pixel_size),
+                              IM_COL32 (48, 48, 48, 255));
+
+    for (int32_t y = 0; y < metasprite_height; y++)
+    {
+        for (int32_t x = 0; x < metasprite_width; x++)
+        {
+            uint8_t value = metasprite_canvas [x + y * METASPRITE_CANVAS_MAX];
+            ImVec2 top_left = ImVec2 (canvas_pos.x + x * pixel_size, canvas_pos.y + y * pixel_size);
+
+            /* Colour 0 is transparent */
+            if (value != 0)
+            {
+                draw_list->AddRectFilled (top_left, ImVec2 (top_left.x + pixel_size, top_left.y + pixel_size),
+                                          ImGui::GetColorU32 (sms_to_imgui_colour (palette [value], 0)));
+            }
+        }
+    }
+
+    /* Sprite outlines */
+    float sprite_height = metasprite.tall ? 16 : 8;
+    for (const Metasprite_Entry &entry : metasprite.entries)
+    {
+        float x = canvas_pos.x + (entry.x + metasprite.origin_x) * pixel_size;
+        float y = canvas_pos.y + (entry.y + metasprite.origin_y) * pixel_size;
+        draw_list->AddRect (ImVec2 (x, y), ImVec2 (x + 8 * pixel_size, y + sprite_height * pixel_size),
+                            IM_COL32 (255, 255, 0, 192));
+    }
+
+    /* Origin */
+    draw_list->AddCircle (ImVec2 (canvas_pos.x + metasprite.origin_x * pixel_size,
+                                  canvas_pos.y + metasprite.origin_y * pixel_size), 3.0f, IM_COL32 (0, 255, 255, 255));
+
+    /* Sprites on each line */
+    uint8_t line_counts [METASPRITE_CANVAS_MAX];
+    uint32_t max_line = 0;
+    metasprite_line_counts (&metasprite, metasprite_height, line_counts);
+
+    for (int32_t line = 0; line < metasprite_height; line++)
+    {
+        float left = canvas_pos.x + METASPRITE_CANVAS_MAX * pixel_size + 4.0f;
+        float top = canvas_pos.y + line * pixel_size;
+        ImU32 colour = (line_counts [line] > VDP_SPRITES_PER_LINE) ? IM_COL32 (255, 64, 64, 255)
+                                                                   : IM_COL32 (64, 200, 64, 255);
+        if (line_counts [line])
+        {
+            draw_list->AddRectFilled (ImVec2 (left, top), ImVec2 (left + line_counts [line] * 4.0f, top + pixel_size), colour);
+        }
+        max_line = std::max (max_line, (uint32_t) line_counts [line]);
+    }
+
+    if (ImGui::Button ("Decompose"))
+    {
+        std::vector<uint8_t> canvas ((size_t) metasprite_width * metasprite_height);
+
+        for (int32_t y = 0; y < metasprite_height; y++)
+        {
+            memcpy (&canvas [y * metasprite_width], &metasprite_canvas [y * METASPRITE_CANVAS_MAX], metasprite_width);
+        }
+
+        uint32_t tiles_before = tile_store.tiles.size ();
+        Metasprite decomposed = metasprite;
+        metasprite_decompose (canvas.data (), metasprite_width, metasprite_height, sprite_8x16,
+                              &tile_store, &decomposed);
+
+        project_edit (JOURNAL_METASPRITE_COUNT, decomposed.entries.size (), decomposed.tall);
+        for (uint32_t i = 0; i < decomposed.entries.size (); i++)
+        {
+            project_edit_metasprite_entry (i, &decomposed.entries [i]);
+        }
+
+        snprintf (metasprite_status, sizeof (metasprite_status), "Decomposed into %u sprites, %u new tiles.",
+                  (uint32_t) metasprite.entries.size (), (uint32_t) tile_store.tiles.size () - tiles_before);
+    }
+
+    ImGui::SameLine ();
+    if (ImGui::Button ("Clear Canvas"))
+    {
+        project_edit (JOURNAL_METASPRITE_CLEAR, 0, 0);
+    }
+
+    ImGui::SameLine ();
+    if (ImGui::Button ("Show in VDP Preview"))
+    {
+        /* Place the origin at the centre of the screen */
+        vdp_scene.sprites.clear ();
+        for (const Metasprite_Entry &entry : metasprite.entries)
+        {
+            Vdp_Sprite sprite = { (int16_t) (VDP_WIDTH / 2 + entry.x), (int16_t) (VDP_HEIGHT / 2 + entry.y), entry.pattern };
+            vdp_scene.sprites.push_back (sprite);
+        }
+        sprite_8x16 = metasprite.tall;
+        vdp_window_open = true;
+    }
+
+    ImGui::SetNextItemWidth (160.0f);
+    ImGui::InputText ("Label", metasprite_label, sizeof (metasprite_label));
+    ImGui::SameLine ();
+    if (ImGui::Button ("Export"))
+    {
+        metasprite_export (&metasprite, metasprite_label);
+    }
+
+    ImGui::Text ("%u sprites, at most %u on a line.", (uint32_t) metasprite.entries.size (), max_line);
+    if (metasprite_status [0] != '\0')
+    {
+        ImGui::TextUnformatted (metasprite_status);
+    }
+
+    /* Hand placement of tiles at any offset */
+    if (ImGui::CollapsingHeader ("Sprites"))
+    {
+        for (uint32_t i = 0; i < metasprite.entries.size (); i++)
+        {
+            const Metasprite_Entry *entry = &metasprite.entries [i];
+            int values [3] = { entry->x, entry->y, entry->pattern };
+
+            ImGui::PushID (i);
+            ImGui::SetNextItemWidth (240.0f);
+            if (ImGui::DragInt3 ("x, y, pattern", values))
+            {
+                Metasprite_Entry edited = { (int16_t) std::min (127, std::max (-128, values [0])),
+                                            (int16_t) std::min (127, std::max (-128, values [1])),
+                                            (uint16_t) std::min (TILE_INDEX_MASK, std::max (0, values [2])) };
+                project_edit_metasprite_entry (i, &edited);
+            }
+            ImGui::SameLine ();
+            if (ImGui::SmallButton ("Remove"))
+            {
+                project_edit (JOURNAL_METASPRITE_REMOVE, i, 0);
+            }
+            ImGui::PopID ();
+        }
+
+        if (metasprite.entries.size () < VDP_SPRITES_MAX && ImGui::Button ("Add Sprite"))
+        {
+            project_edit (JOURNAL_METASPRITE_COUNT, metasprite.entries.size () + 1, metasprite.tall);
+        }
+    }
+
+    ImGui::End ();
+}
+
+
+/*
+ * Animation timeline window.
+ */
+void animation_window (void)
+{
+    if (!animation_window_open)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowSize (ImVec2 (560, 480), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin ("Animation Timeline", &animation_window_open))
+    {
+        ImGui::End ();
+        return;
+    }
+
+    if (ImGui::Button ("Add Frame from Metasprite"))
+    {
+        if (metasprite.entries.empty ())
+        {
+            snprintf (animation_status, sizeof (animation_status), "The metasprite has no sprites.");
+        }
+        else if (!animation.frames.empty () && animation.frames [0].sprite.tall != metasprite.tall)
+        {
+            snprintf (animation_status, sizeof (animation_status), "All frames must use the same sprite size.");
+        }
+        else
+        {
+            Animation_Frame frame = { metasprite, 8 };
+            animation.frames.push_back (frame);
+            animation_stream (&animation);
+            animation_status [0] = '\0';
+        }
+    }
+
+    ImGui::SameLine ();
+    if (ImGui::Button ("VBlank Settings..."))
+    {
+        vblank_window_open = true;
+    }
+
+    if (animation_status [0] != '\0')
+    {
+        ImGui::TextUnformatted (animation_status);
+    }
+
+    ImGui::Text ("Streaming buffer: %u patterns. First frame: %u bytes.",
+                 animation.buffer_slots, animation.initial_bytes);
+
+    /* Frame list, with the upload into each frame */
+    ImGui::Columns (4, "frames");
+    ImGui::Text ("Frame");          ImGui::NextColumn ();
+    ImGui::Text ("Duration");       ImGui::NextColumn ();
+    ImGui::Text ("Upload");         ImGui::NextColumn ();
+    ImGui::NextColumn ();
+    ImGui::Separator ();
+
+    uint32_t over_budget = 0;
+    int32_t remove = -1;
+
+    vblank_analyse_animation (&vblank_settings, &animation, &vblank_frame_reports);
+
+    for (uint32_t f = 0; f < animation.frames.size (); f++)
+    {
+        Animation_Frame *frame = &animation.frames [f];
+        const Animation_Delta *delta = &animation.deltas [f];
+        int duration = frame->duration;
+
+        ImGui::PushID (f);
+        ImGui::Text ("%u (%u sprites)", f, (uint32_t) frame->sprite.entries.size ());
+        ImGui::NextColumn ();
+
+        ImGui::SetNextItemWidth (-1.0f);
+        if (ImGui::DragInt ("##duration", &duration, 0.1f, 1, 255))
+        {
+            frame->duration = duration;
+        }
+        ImGui::NextColumn ();
+
+        if (!vblank_frame_reports [f].fits)
+        {
+            ImGui::TextColored (ImVec4 (1.0f, 0.3f, 0.3f, 1.0f), "%u tiles, %u bytes",
+                                (uint32_t) delta->uploads.size (), delta->bytes);
+            if (ImGui::IsItemHovered ())
+            {
+                ImGui::SetTooltip ("%s", vblank_frame_reports [f].suggestion.c_str ());
+            }
+            over_budget++;
+        }
+        else
+        {
+            ImGui::Text ("%u tiles, %u bytes", (uint32_t) delta->uploads.size (), delta->bytes);
+        }
+        ImGui::NextColumn ();
+
+        if (ImGui::SmallButton ("Edit"))
+        {
+            metasprite = frame->sprite;
+            metasprite_window_open = true;
+        }
+        ImGui::SameLine ();
+        if (ImGui::SmallButton ("Replace"))
+        {
+            if (metasprite.tall == frame->sprite.tall && !metasprite.entries.empty ())
+            {
+                frame->sprite = metasprite;
+                animation_stream (&animation);
+            }
+        }
+        ImGui::SameLine ();
+        if (ImGui::SmallButton ("Remove"))
+        {
+            remove = f;
+        }
+        ImGui::NextColumn ();
+        ImGui::PopID ();
+    }
+    ImGui::Columns (1);
+
+    if (remove >= 0)
+    {
+        animation.frames.erase (animation.frames.begin () + remove);
+        animation_stream (&animation);
+    }
+
+    if (over_budget)
+    {
+        ImGui::TextColored (ImVec4 (1.0f, 0.3f, 0.3f, 1.0f), "%u frames exceed the VBlank budget.", over_budget);
+    }
+
+    ImGui::SetNextItemWidth (160.0f);
+    ImGui::InputText ("Label", animation_label, sizeof (animation_label));
+    ImGui::SameLine ();
+    if (ImGui::Button ("Export") && !animation.frames.empty ())
+    {
+        animation_export (&animation, animation_label);
+    }
+
+    ImGui::End ();
+}
+
+
+/*
+ * Show one row of the VBlank analyser.
+ */
+void vblank_report_row (const char *name, const Vblank_Report *report)
+{
+    uint32_t budget = vblank_budget (&vblank_settings);
+    ImVec4 colour = report->fits ? ImVec4 (0.4f, 0.9f, 0.4f, 1.0f) : ImVec4 (1.0f, 0.3f, 0.3f, 1.0f);
+
+    ImGui::TextUnformatted (name);                              ImGui::NextColumn ();
+    ImGui::Text ("%u", report->bytes);                          ImGui::NextColumn ();
+    ImGui::Text ("%u", report->cycles);                         ImGui::NextColumn ();
+    ImGui::TextColored (colour, "%.0f%%", budget ? 100.0f * report->cycles / budget : 0.0f);
+    ImGui::NextColumn ();
+    ImGui::Text ("%u", report->vblanks);                        ImGui::NextColumn ();
+    ImGui::TextWrapped ("%s", report->suggestion.c_str ());     ImGui::NextColumn ();
+}
+
+
+/*
+ * VBlank transfer budget window.
+ */
+void vblank_window (void)
+{
+    if (!vblank_window_open)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowSize (ImVec2 (720, 420), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin ("VBlank Analyser", &vblank_window_open))
+    {
+        ImGui::End ();
+        return;
+    }
+
+    int region = vblank_settings.region;
+    int method = vblank_settings.method;
+    int reserved = vblank_settings.reserved_cycles;
+
+    ImGui::SetNextItemWidth (140.0f);
+    ImGui::Combo ("Region", &region, vblank_region_names, VBLANK_REGION_COUNT);
+    ImGui::SameLine ();
+    ImGui::SetNextItemWidth (140.0f);
+    ImGui::Combo ("Write method", &method, vblank_method_names, VBLANK_METHOD_COUNT);
+    ImGui::SetNextItemWidth (140.0f);
+    ImGui::InputInt ("Reserved cycles", &reserved, 100);
+    ImGui::SameLine ();
+    ImGui::Checkbox ("Include SAT upload", &vblank_settings.include_sat);
+
+    vblank_settings.region = (Vblank_Region) region;
+    vblank_settings.method = (Vblank_Method) method;
+    vblank_settings.reserved_cycles = std::max (reserved, 0);
+
+    uint32_t budget = vblank_budget (&vblank_settings);
+    ImGui::Text ("%u cycles available per VBlank, about %u bytes of patterns.", budget,
+                 budget / std::max (1u, vblank_transfer_cycles (vblank_settings.method, 32, 1) / 32));
+
+    ImGui::Columns (6, "transfers");
+    ImGui::Text ("Transfer");       ImGui::NextColumn ();
+    ImGui::Text ("Bytes");          ImGui::NextColumn ();
+    ImGui::Text ("Cycles");         ImGui::NextColumn ();
+    ImGui::Text ("Budget");         ImGui::NextColumn ();
+    ImGui::Text ("VBlanks");        ImGui::NextColumn ();
+    ImGui::Text ("Suggestion");     ImGui::NextColumn ();
+    ImGui::Separator ();
+
+    Vblank_Report report;
+    char name [64];
+
+    /* Exported patterns and map */
+    vblank_analyse (&vblank_settings, tile_store.tiles.size () * 32, 1, &report);
+    if (!report.fits)
+    {
+        report.suggestion = "Load with the display off, or stream a part each frame.";
+    }
+    snprintf (name, sizeof (name), "Tileset (%u patterns)", (uint32_t) tile_store.tiles.size ());
+    vblank_report_row (name, &report);
+
+    /* Name table rows are only contiguous when the map is the full 32 tiles wide */
+    uint32_t map_columns = std::min (tile_map.width, 32u);
+    uint32_t map_rows = std::min (tile_map.height, 24u);
+    vblank_analyse (&vblank_settings, map_columns * map_rows * 2, (map_columns == 32) ? 1 : map_rows, &report);
+    if (!report.fits)
+    {
+        report.suggestion = "Load with the display off, or update a row at a time.";
+    }
+    vblank_report_row ("Tile map (one screen)", &report);
+
+    vblank_analyse (&vblank_settings, map_rows * 2, map_rows, &report);
+    vblank_report_row ("Tile map column (scrolling)", &report);
+
+    /* Animation deltas */
+    vblank_analyse_animation (&vblank_settings, &animation, &vblank_frame_reports);
+    for (uint32_t f = 0; f < vblank_frame_reports.size (); f++)
+    {
+        snprintf (name, sizeof (name), "Animation frame %u", f);
+        vblank_report_row (name, &vblank_frame_reports [f]);
+    }
+
+    ImGui::Columns (1);
+    ImGui::End ();
+}
+
+
+/*
+ * Main menu bar (top)
+ */
+void menu_bar (void)
+{
+    if (ImGui::BeginMainMenuBar ())
+    {
+        if (ImGui::BeginMenu ("File"))
+        {
+            if (ImGui::MenuItem ("New Tab", NULL, false, !document_busy ()))
+            {
+                document_new (false);
+                project_documents_changed ();
+            }
+
+            if (ImGui::MenuItem ("Duplicate Tab", NULL, false, !document_busy ()))
+            {
+                document_new (true);
+                project_documents_changed ();
+            }
+
+            ImGui::Separator ();
+
+            if (ImGui::MenuItem ("Import Image..."))
+            {
+                import_dialog_open = true;
+            }
+
+            ImGui::Separator ();
+
+            if (ImGui::MenuItem ("Export Palette"))
+            {
+                export_palette ();
+            }
+
+            if (ImGui::MenuItem ("Export Tile (uint8_t)"))
+            {
+                export_tile (false);
+            }
+
+            if (ImGui::MenuItem ("Export Tile (uint32_t)"))
+            {
+                export_tile (true);
+            }
+
+            if (ImGui::MenuItem ("Export Tileset", NULL, false, !tile_store.tiles.empty ()))
+            {
+                export_tileset ();
+            }
+
+            if (ImGui::MenuItem ("Export Tile Map", NULL, false, !tile_store.tiles.empty ()))
+            {
+                export_tile_map ();
+            }
+
+            ImGui::Separator ();
+
+            if (ImGui::MenuItem ("Quit"))
+            {
+                running = false;
+            }
+
+            ImGui::EndMenu ();
+        }
+
+        if (ImGui::BeginMenu ("Palette"))
+        {
+            if (ImGui::MenuItem ("Optimise for Images..."))
+            {
+                palette_dialog_open = true;
+            }
+
+            ImGui::EndMenu ();
+        }
+
+        if (ImGui::BeginMenu ("Tiles"))
+        {
+            if (ImGui::MenuItem ("Reduce Tile Count...", NULL, false, !tile_store.tiles.empty ()))
+            {
+                reduce_dialog_open = true;
+            }
+
+            ImGui::Separator ();
+            ImGui::MenuItem ("8×16 Sprites", NULL, &sprite_8x16);
+
+            ImGui::EndMenu ();
+        }
+
+        if (ImGui::BeginMenu ("View"))
+        {
+            ImGui::MenuItem ("Animation Timeline", NULL, &animation_window_open);
+            ImGui::MenuItem ("Performance HUD", "F3", &hud_open);
+            ImGui::MenuItem ("Tile Map", NULL, &map_window_open);
+            ImGui::MenuItem ("Tileset", NULL, &tileset_window_open);
+            ImGui::MenuItem ("Metasprite Editor", NULL, &metasprite_window_open);
+            ImGui::MenuItem ("VBlank Analyser", NULL, &vblank_window_open);
+            ImGui::MenuItem ("VDP Preview", NULL, &vdp_window_open);
+            ImGui::MenuItem ("VRAM Planner", NULL, &vram_window_open);
+
+            ImGui::Separator ();
+            if (ImGui::MenuItem ("Record Trace", NULL, trace_recording ()))
+            {
+                if (trace_recording ())
+                {
+                    trace_save ();
+                }
+                else
+                {
+                    trace_start ();
+                }
+            }
+
+            ImGui::EndMenu ();
+        }
+
+        if (ImGui::BeginMenu ("Size"))
+        {
+            if (ImGui::MenuItem ("1 × 1"))
+            {
+                project_edit (JOURNAL_TILE_COUNT, 0, 1);
+            }
+            if (ImGui::MenuItem ("2 × 2"))
+            {
+                project_edit (JOURNAL_TILE_COUNT, 0, 2);
+            }
+
+            ImGui::EndMenu ();
+        }
+
+        /* Background job progress */
+        for (uint32_t i = 0; i < jobs_active_count (); i++)
+        {
+            Job *job = jobs_active_get (i);
+
+            ImGui::Separator ();
+            ImGui::Text ("%s", job->name);
+            ImGui::SetNextItemWidth (100.0f);
+            ImGui::ProgressBar (job_progress (job), ImVec2 (100.0f, 0.0f));
+            ImGui::PushID (job);
+            if (!job->cancelled && ImGui::SmallButton ("Cancel"))
+            {
+                job_cancel (job);
             }
+            ImGui::PopID ();
         }
-    }
 
-    printf ("};\n");
+        ImGui::EndMainMenuBar ();
+    }
 }
 
+
 /*
- * Main menu bar (top)
+ * Tab bar, with a tab for each open document.
  */
-void menu_bar (void)
+void document_tabs (void)
 {
-    if (ImGui::BeginMainMenuBar ())
+    float height = ImGui::GetFrameHeight ();
+
+    ImGui::SetNextWindowPos (ImVec2 (0.0f, height));
+    ImGui::SetNextWindowSize (ImVec2 (host_width, height));
+
+    ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize |
+                                    ImGuiWindowFlags_NoMove     | ImGuiWindowFlags_NoScrollbar |
+                                    ImGuiWindowFlags_NoScrollWithMouse | ImGuiWindowFlags_NoBackground;
+
+    ImGui::PushStyleVar (ImGuiStyleVar_WindowPadding, ImVec2 (BORDER_SIZE, 0.0f));
+    ImGui::PushStyleVar (ImGuiStyleVar_WindowBorderSize, 0.0f);
+    ImGui::Begin ("documents", NULL, window_flags);
+    ImGui::PopStyleVar (2);
+
+    uint32_t shown = UINT32_MAX;
+    uint32_t close = UINT32_MAX;
+
+    if (ImGui::BeginTabBar ("documents", ImGuiTabBarFlags_FittingPolicyScroll))
     {
-        if (ImGui::BeginMenu ("File"))
+        for (uint32_t i = 0; i < documents.size (); i++)
         {
-            if (ImGui::MenuItem ("Export Palette"))
-            {
-                export_palette ();
-            }
+            Document *document = documents [i];
+            char label [80];
+            bool open = true;
 
-            if (ImGui::MenuItem ("Export Tile (uint8_t)"))
+            /* Bring the tab bar into line after a switch it did not make */
+            ImGuiTabItemFlags flags = (i == document_active && document->id != document_shown_id) ?
+                                      ImGuiTabItemFlags_SetSelected : 0;
+
+            snprintf (label, sizeof (label), "%s###%u", document->name, document->id);
+            if (ImGui::BeginTabItem (label, (documents.size () > 1) ? &open : NULL, flags))
             {
-                export_tile (false);
+                shown = i;
+                ImGui::EndTabItem ();
             }
 
-            if (ImGui::MenuItem ("Export Tile (uint32_t)"))
+            if (!open)
             {
-                export_tile (true);
+                close = i;
             }
+        }
 
-            ImGui::Separator ();
+        ImGui::EndTabBar ();
+    }
 
-            if (ImGui::MenuItem ("Quit"))
-            {
-                running = false;
-            }
+    ImGui::End ();
 
-            ImGui::EndMenu ();
-        }
+    /* A change in the shown tab, other than catching up with document_active, is a click.
+     * While a job is running its result belongs to the active document, so the switch waits. */
+    if (shown != UINT32_MAX && documents [shown]->id != document_shown_id)
+    {
+        document_shown_id = documents [shown]->id;
 
-        if (ImGui::BeginMenu ("Size"))
+        if (!document_busy ())
         {
-            if (ImGui::MenuItem ("1 × 1"))
-            {
-                tile_count = 1;
-            }
-            if (ImGui::MenuItem ("2 × 2"))
-            {
-                tile_count = 2;
-            }
-
-            ImGui::EndMenu ();
+            document_select (shown);
         }
+    }
 
-        ImGui::EndMainMenuBar ();
+    if (close != UINT32_MAX && (close != document_active || !document_busy ()))
+    {
+        document_close (close);
+        project_documents_changed ();
     }
 }
 
@@ -202,27 +2483,42 @@ void editing_area (void)
     uint32_t free_height = host_height - palette_bar_height;
     uint32_t pixel_size = ((free_height * 0.8) - (2 * BORDER_SIZE)) / (8 * tile_count);
     uint32_t window_size = (8 * pixel_size * tile_count) + (2 * BORDER_SIZE);
+    uint32_t canvas_size = 8 * tile_count;
 
     ImGui::SetNextWindowPos (ImVec2 ((host_width - window_size) / 2, (free_height - window_size) / 2));
     ImGui::SetNextWindowSize (ImVec2 (window_size, window_size));
 
     ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize |
-                                    ImGuiWindowFlags_NoMove     | ImGuiWindowFlags_NoScrollbar;
+                                    ImGuiWindowFlags_NoMove     | ImGuiWindowFlags_NoScrollbar |
+                                    ImGuiWindowFlags_NoScrollWithMouse;
 
     ImGui::Begin ("editing_area", NULL, window_flags);
 
+    /* Fit the canvas to the window whenever the window or canvas size changes */
+    if (pixel_size != canvas_fit)
+    {
+        canvas_view.zoom = canvas_view.zoom_target = pixel_size;
+        canvas_fit = pixel_size;
+    }
+
+    ImVec2 origin = ImGui::GetCursorScreenPos ();
+    ImVec2 size (canvas_size * pixel_size, canvas_size * pixel_size);
+    canvas_view_update (&canvas_view, origin, size, ImVec2 (canvas_size, canvas_size), ImGui::IsWindowHovered (),
+                        pixel_size, pixel_size * 16.0f);
+
+    float zoomed_size = canvas_view.zoom;
+
+    ImGui::PushClipRect (origin, ImVec2 (origin.x + size.x, origin.y + size.y), true);
     ImGui::PushStyleVar (ImGuiStyleVar_FrameRounding, 0.0f);
-    ImGui::PushStyleVar (ImGuiStyleVar_ItemSpacing, ImVec2 (0.0f, 0.0f));
 
     for (uint32_t i = 0; i < (64 *  tile_count * tile_count); i++)
     {
         uint32_t tile_index = i;
+        uint32_t pixel_x = i % canvas_size;
+        uint32_t pixel_y = i / canvas_size;
 
         if (tile_count == 2)
         {
-            uint32_t pixel_x = i % 16;
-            uint32_t pixel_y = i / 16;
-
             /* 1 × 1 tile base index */
             tile_index = 64 * ((pixel_x / 8) + (pixel_y / 8) * 2);
 
@@ -231,28 +2527,31 @@ void editing_area (void)
 
         }
 
+        /* Skip pixels that have been panned out of view */
+        ImVec2 position (origin.x + (pixel_x - canvas_view.pan.x) * zoomed_size,
+                         origin.y + (pixel_y - canvas_view.pan.y) * zoomed_size);
+        if (position.x + zoomed_size <= origin.x || position.x >= origin.x + size.x ||
+            position.y + zoomed_size <= origin.y || position.y >= origin.y + size.y)
+        {
+            continue;
+        }
+        ImGui::SetCursorScreenPos (position);
+
         ImGui::PushStyleColor (ImGuiCol_Button,        sms_to_imgui_colour (palette [tile [tile_index]], 0));
         ImGui::PushStyleColor (ImGuiCol_ButtonHovered, sms_to_imgui_colour (palette [tile [tile_index]], 1));
         ImGui::PushStyleColor (ImGuiCol_ButtonActive,  sms_to_imgui_colour (palette [tile [tile_index]], 2));
 
-        if (ImGui::Button (tile_strings [tile_index], ImVec2 (pixel_size, pixel_size)))
+        if (ImGui::Button (tile_strings [tile_index], ImVec2 (zoomed_size, zoomed_size)) &&
+            tile [tile_index] != active_palette_index)
         {
-            tile [tile_index] = active_palette_index;
+            project_edit (JOURNAL_PIXEL, tile_index, active_palette_index);
         }
 
         ImGui::PopStyleColor (3);
-
-        if (tile_count == 1 && (i % 8 != 7))
-        {
-            ImGui::SameLine ();
-        }
-        else if (tile_count == 2 && (i % 16 != 15))
-        {
-            ImGui::SameLine ();
-        }
     }
 
-    ImGui::PopStyleVar (2);
+    ImGui::PopStyleVar ();
+    ImGui::PopClipRect ();
 
     ImGui::End ();
 }
@@ -310,53 +2609,450 @@ void palette_bar (void)
     ImGui::End ();
 }
 
+/* Parts of the user interface, timed individually for the performance HUD */
+typedef struct Gui_Section_s {
+    const char *name;
+    void (*fn) (void);
+    float ms;               /* Smoothed CPU time */
+} Gui_Section;
+
+Gui_Section gui_sections [] = {
+    { "menu_bar",           menu_bar,           0.0f },
+    { "document_tabs",      document_tabs,      0.0f },
+    { "editing_area",       editing_area,       0.0f },
+    { "palette_bar",        palette_bar,        0.0f },
+    { "import_dialog",      import_dialog,      0.0f },
+    { "palette_dialog",     palette_dialog,     0.0f },
+    { "tile_reduce_dialog", tile_reduce_dialog, 0.0f },
+    { "tileset_window",     tileset_window,     0.0f },
+    { "map_window",         map_window,         0.0f },
+    { "metasprite_window",  metasprite_window,  0.0f },
+    { "animation_window",   animation_window,   0.0f },
+    { "vblank_window",      vblank_window,      0.0f },
+    { "vdp_window",         vdp_window,         0.0f },
+    { "vram_window",        vram_window,        0.0f },
+};
+#define GUI_SECTION_COUNT (sizeof (gui_sections) / sizeof (gui_sections [0]))
+
+
+/*
+ * Performance overlay, showing the previous frame's numbers.
+ */
+void performance_hud (void)
+{
+    if (!hud_open)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowPos (ImVec2 (host_width - 8.0f, 28.0f), ImGuiCond_Always, ImVec2 (1.0f, 0.0f));
+    ImGui::SetNextWindowBgAlpha (0.75f);
+    ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                                    ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+                                    ImGuiWindowFlags_NoNav;
+
+    if (!ImGui::Begin ("Performance", &hud_open, window_flags))
+    {
+        ImGui::End ();
+        return;
+    }
+
+    /* Frame times, oldest first */
+    float ordered [HUD_HISTORY];
+    float histogram [HUD_BUCKETS] = { 0.0f };
+    float worst = 0.0f;
+    float total = 0.0f;
+
+    for (uint32_t i = 0; i < HUD_HISTORY; i++)
+    {
+        float ms = hud_frame_ms [(hud_frame_index + i) % HUD_HISTORY];
+        ordered [i] = ms;
+        histogram [std::min ((uint32_t) ms, (uint32_t) HUD_BUCKETS - 1)] += 1.0f;
+        worst = std::max (worst, ms);
+        total += ms;
+    }
+
+    ImGui::Text ("Frame: %.2f ms average, %.2f ms worst", total / HUD_HISTORY, worst);
+    ImGui::PlotLines ("##frame_times", ordered, HUD_HISTORY, 0, NULL, 0.0f, 33.3f, ImVec2 (260, 40));
+    ImGui::PlotHistogram ("##frame_histogram", histogram, HUD_BUCKETS, 0, "0 - 32 ms", 0.0f, FLT_MAX, ImVec2 (260, 40));
+
+    /* Draw data */
+    const ImGui_ImplOpenGL3_FrameStats *stats = ImGui_ImplOpenGL3_GetFrameStats ();
+    ImGui::Separator ();
+    ImGui::Text ("Items: %u  Draw lists: %d  Draw calls: %d", hud_items_last, hud_cmd_lists_last, stats->DrawCalls);
+    ImGui::Text ("Vertices: %d  Indices: %d", hud_vertices_last, hud_indices_last);
+    ImGui::Text ("Uploads: %.1f KiB vertex, %.1f KiB index, %.1f KiB texture",
+                 stats->VertexBytes / 1024.0f, stats->IndexBytes / 1024.0f,
+                 (stats->TextureBytes + hud_texture_bytes_last) / 1024.0f);
+    ImGui::Text ("Tile atlas: %u drawn, %u evicted, %u dropped", tile_atlas.drawn, tile_atlas.evicted, tile_atlas.dropped);
+
+    /* Time in each part of the interface */
+    ImGui::Separator ();
+    for (uint32_t i = 0; i < GUI_SECTION_COUNT; i++)
+    {
+        if (gui_sections [i].ms >= 0.001f)
+        {
+            ImGui::Text ("%-20s %7.3f ms", gui_sections [i].name, gui_sections [i].ms);
+        }
+    }
+
+    ImGui::End ();
+}
+
+
+/*
+ * Build the user interface for one frame.
+ */
+void gui_frame (void)
+{
+    right_button_used = false;
+    tile_atlas_set_palette (&tile_atlas, 0, palette);
+
+    for (uint32_t i = 0; i < GUI_SECTION_COUNT; i++)
+    {
+        TRACE_ZONE (gui_sections [i].name);
+        uint64_t start = SDL_GetPerformanceCounter ();
+        gui_sections [i].fn ();
+        float ms = (SDL_GetPerformanceCounter () - start) * 1000.0f / SDL_GetPerformanceFrequency ();
+
+        gui_sections [i].ms += (ms - gui_sections [i].ms) * 0.1f;
+    }
+
+    performance_hud ();
+
+    tile_atlas_flush (&tile_atlas);
+    hud_texture_bytes += tile_atlas.upload_bytes + map_mip.upload_bytes;
+    map_mip.upload_bytes = 0;
+}
+
+
+/*
+ * Run the user interface for a number of frames with scripted input, and report
+ * the CPU time and draw data of each frame. Needs no window, unless use_gl is
+ * set, in which case the frames are also drawn into a hidden window.
+ */
+int benchmark_ui (uint32_t frames, bool use_gl, bool json)
+{
+    host_width = BENCHMARK_UI_WIDTH;
+    host_height = BENCHMARK_UI_HEIGHT;
+
+    if (use_gl)
+    {
+        if (SDL_Init (SDL_INIT_VIDEO) == -1)
+        {
+            fprintf (stderr, "SDL_Init failure: %s\n", SDL_GetError ());
+            return EXIT_FAILURE;
+        }
+
+        SDL_GL_SetAttribute (SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
+        SDL_GL_SetAttribute (SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+        SDL_GL_SetAttribute (SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        SDL_GL_SetAttribute (SDL_GL_CONTEXT_MINOR_VERSION, 2);
+        window = SDL_CreateWindow ("Snepsprite", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                   host_width, host_height, SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL);
+        gl_context = (window != NULL) ? SDL_GL_CreateContext (window) : NULL;
+
+        if (gl_context == NULL || gl3wInit () != 0)
+        {
+            fprintf (stderr, "Unable to create an OpenGL context: %s\n", SDL_GetError ());
+            SDL_Quit ();
+            return EXIT_FAILURE;
+        }
+        SDL_GL_SetSwapInterval (0);
+    }
+
+    ImGui::CreateContext ();
+    ImGuiIO &io = ImGui::GetIO ();
+    io.IniFilename = NULL;
+    io.DisplaySize = ImVec2 (host_width, host_height);
+    io.DeltaTime = 1.0f / 60.0f;
+    ImGui::GetStyle ().FrameRounding = 2.0f;
+
+    if (use_gl)
+    {
+        ImGui_ImplOpenGL3_Init ();
+    }
+    else
+    {
+        /* Without a renderer backend the font atlas must still be built */
+        unsigned char *pixels;
+        int width;
+        int height;
+        io.Fonts->GetTexDataAsRGBA32 (&pixels, &width, &height);
+    }
+    renderer_headless = !use_gl;
+    tile_atlas_init (&tile_atlas, renderer_headless);
+    mip_init (&map_mip, renderer_headless);
+    document_init ();
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        sprintf (tile_strings [i], "##%02x", i);
+    }
+
+    jobs_init (0);
+
+    vram_layout_init (&vram_layout);
+
+    if (json)
+    {
+        printf ("{\n  \"frames\": %u,\n  \"gl\": %s,\n  \"results\": [\n", frames, use_gl ? "true" : "false");
+    }
+    else
+    {
+        printf ("%-8s %8s %8s %10s %10s %10s %8s %10s %10s %8s\n",
+                "canvas", "tileset", "map", "median ms", "p95 ms", "max ms", "items", "vertices", "indices", "draws");
+    }
+
+    /* Measure each canvas size in turn, then the tileset browser with a small
+     * and a large store, which should cost about the same, then an overview of
+     * a 4096 × 4096 pixel tile map. */
+    static const struct { uint32_t canvas; uint32_t tileset; uint32_t map; } scenarios [] = {
+        { 1, 0, 0 }, { 2, 0, 0 }, { 1, 50, 0 }, { 1, 100000, 0 }, { 1, 0, 512 }
+    };
+    const uint32_t scenario_count = sizeof (scenarios) / sizeof (scenarios [0]);
+
+    for (uint32_t scenario = 0; scenario < scenario_count; scenario++)
+    {
+        tile_count = scenarios [scenario].canvas;
+        tileset_window_open = scenarios [scenario].tileset > 0;
+        map_window_open = scenarios [scenario].map > 0;
+
+        /* Fill the store with distinct tiles, and the map with a pattern of them */
+        tile_store_clear (&tile_store);
+        tile_store.tiles.resize (map_window_open ? 4096 : scenarios [scenario].tileset);
+        for (uint32_t t = 0; t < tile_store.tiles.size (); t++)
+        {
+            Tile *synthetic = tile_store.tiles.write (t);
+            for (uint32_t p = 0; p < 64; p++)
+            {
+                synthetic->pixel [p] = (t >> (p % 17)) + p;
+            }
+        }
+        tile_map.width = scenarios [scenario].map;
+        tile_map.height = scenarios [scenario].map;
+        tile_map.entry.resize (tile_map.width * tile_map.height);
+        for (uint32_t i = 0; i < tile_map.entry.size (); i++)
+        {
+            *tile_map.entry.write (i) = ((i * 7) % tile_store.tiles.size ()) | ((i & 3) << 17);
+        }
+        tile_atlas_invalidate (&tile_atlas);
+        map_view_reset ();
+
+        std::vector<double> times;
+        uint64_t items = 0;
+        uint64_t vertices = 0;
+        uint64_t indices = 0;
+        uint64_t draws = 0;
+
+        for (uint32_t frame = 0; frame < frames; frame++)
+        {
+            /* Sweep the mouse across the editing area, clicking on every other frame,
+             * and pick a new colour from the palette bar every sixteenth frame. */
+            if (frame % 16 == 15 && palette_bar_height > 0)
+            {
+                io.MousePos = ImVec2 (host_width * (0.1f + 0.05f * ((frame / 16) % 16)),
+                                      host_height - palette_bar_height / 2.0f);
+            }
+            else
+            {
+                io.MousePos = ImVec2 ((frame * 24) % host_width,
+                                      40 + ((frame * 24) / host_width * 16) % (host_height - palette_bar_height - 80));
+            }
+            io.MouseDown [0] = (frame % 2) == 1;
+            io.MouseWheel = tileset_window_open ? -1.0f : 0.0f;
+
+            TRACE_ZONE ("frame");
+            uint64_t start = SDL_GetPerformanceCounter ();
+
+            if (use_gl)
+            {
+                ImGui_ImplOpenGL3_NewFrame ();
+            }
+            ImGui::NewFrame ();
+            gui_frame ();
+            {
+                TRACE_ZONE ("render");
+                ImGui::Render ();
+            }
+
+            if (use_gl)
+            {
+                TRACE_ZONE ("draw");
+                glViewport (0, 0, host_width, host_height);
+                glClear (GL_COLOR_BUFFER_BIT);
+                ImGui_ImplOpenGL3_RenderDrawData (ImGui::GetDrawData ());
+                glFinish ();
+            }
+
+            times.push_back ((SDL_GetPerformanceCounter () - start) * 1000.0 / SDL_GetPerformanceFrequency ());
+
+            ImDrawData *draw_data = ImGui::GetDrawData ();
+            items += ui_item_count;
+            vertices += draw_data->TotalVtxCount;
+            indices += draw_data->TotalIdxCount;
+            for (int i = 0; i < draw_data->CmdListsCount; i++)
+            {
+                draws += draw_data->CmdLists [i]->CmdBuffer.Size;
+            }
+        }
+
+        std::sort (times.begin (), times.end ());
+        double median = times [times.size () / 2];
+        double p95 = times [times.size () * 95 / 100];
+        double max = times.back ();
+
+        if (json)
+        {
+            printf ("    { \"canvas\": %u, \"tileset\": %u, \"map\": %u, \"ms_median\": %.4f, \"ms_p95\": %.4f, \"ms_max\": %.4f, "
+                    "\"items\": %.1f, \"vertices\": %.1f, \"indices\": %.1f, \"draw_calls\": %.1f }%s\n",
+                    tile_count, scenarios [scenario].tileset, scenarios [scenario].map, median, p95, max, (double) items / frames,
+                    (double) vertices / frames, (double) indices / frames, (double) draws / frames,
+                    scenario + 1 < scenario_count ? "," : "");
+        }
+        else
+        {
+            printf ("%u×%-6u %8u %8u %10.4f %10.4f %10.4f %8.1f %10.1f %10.1f %8.1f\n", tile_count, tile_count,
+                    scenarios [scenario].tileset, scenarios [scenario].map, median, p95, max, (double) items / frames,
+                    (double) vertices / frames, (double) indices / frames, (double) draws / frames);
+        }
+    }
+
+    tileset_window_open = false;
+    map_window_open = false;
+    tile_store_clear (&tile_store);
+    tile_map.entry.clear ();
+    tile_map.width = 0;
+    tile_map.height = 0;
+
+    if (json)
+    {
+        printf ("  ]\n}\n");
+    }
+
+    jobs_shutdown ();
+
+    if (trace_recording ())
+    {
+        trace_save ();
+    }
+
+    document_free_all ();
+    tile_atlas_free (&tile_atlas);
+    mip_free (&map_mip);
+    if (use_gl)
+    {
+        ImGui_ImplOpenGL3_Shutdown ();
+        SDL_GL_DeleteContext (gl_context);
+        SDL_DestroyWindow (window);
+        SDL_Quit ();
+    }
+    ImGui::DestroyContext ();
+
+    return EXIT_SUCCESS;
+}
+
+
 /*
  * Main GUI loop.
  */
 int main_gui_loop (void)
 {
+    uint64_t frame_start = SDL_GetPerformanceCounter ();
+
     while (running)
     {
+        TRACE_ZONE ("frame");
         SDL_GetWindowSize (window, &host_width, &host_height);
         SDL_Event event;
 
         /* Handle input */
-        while (SDL_PollEvent (&event))
         {
-            /* Allow ImGui buttons to be clicked with the right mouse button */
-            if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP)
+            TRACE_ZONE ("events");
+
+            while (SDL_PollEvent (&event))
             {
-                if (event.button.button == SDL_BUTTON_RIGHT)
+                /* Allow ImGui buttons to be clicked with the right mouse button,
+                 * other than over items that use the right button themselves */
+                if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP)
                 {
-                    event.button.button = SDL_BUTTON_LEFT;
+                    if (event.button.button == SDL_BUTTON_RIGHT && !right_button_used)
+                    {
+                        event.button.button = SDL_BUTTON_LEFT;
+                    }
                 }
-            }
 
-            ImGui_ImplSDL2_ProcessEvent (&event);
+                ImGui_ImplSDL2_ProcessEvent (&event);
 
-            if (event.type == SDL_QUIT)
-            {
-                running = false;
+                if (event.type == SDL_QUIT)
+                {
+                    running = false;
+                }
+
+                if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F3)
+                {
+                    hud_open = !hud_open;
+                }
             }
         }
 
+        /* Collect results from background jobs */
+        {
+            TRACE_ZONE ("jobs_poll");
+            jobs_poll ();
+        }
+
         /* Render */
-        ImGui_ImplOpenGL3_NewFrame ();
-        ImGui_ImplSDL2_NewFrame (window);
-        ImGui::NewFrame ();
+        {
+            TRACE_ZONE ("new_frame");
+            ImGui_ImplOpenGL3_NewFrame ();
+            ImGui_ImplSDL2_NewFrame (window);
+            ImGui::NewFrame ();
+        }
 
-        menu_bar ();
-        editing_area ();
-        palette_bar ();
+        gui_frame ();
 
         /* Draw to HW */
-        ImGui::Render ();
-        SDL_GL_MakeCurrent (window, gl_context);
-        glViewport (0, 0, (int) ImGui::GetIO ().DisplaySize.x, (int) ImGui::GetIO ().DisplaySize.y);
-        glClearColor (0.0, 0.0, 0.0, 0.0);
-        glClear (GL_COLOR_BUFFER_BIT);
-        ImGui_ImplOpenGL3_RenderDrawData (ImGui::GetDrawData ());
-        SDL_GL_SwapWindow (window);
+        {
+            TRACE_ZONE ("render");
+            ImGui::Render ();
+        }
+
+        ImDrawData *draw_data = ImGui::GetDrawData ();
+        hud_items_last = ui_item_count;
+        hud_vertices_last = draw_data->TotalVtxCount;
+        hud_indices_last = draw_data->TotalIdxCount;
+        hud_cmd_lists_last = draw_data->CmdListsCount;
+        hud_texture_bytes_last = hud_texture_bytes;
+        hud_texture_bytes = 0;
+
+        {
+            TRACE_ZONE ("draw");
+            SDL_GL_MakeCurrent (window, gl_context);
+            glViewport (0, 0, (int) ImGui::GetIO ().DisplaySize.x, (int) ImGui::GetIO ().DisplaySize.y);
+            glClearColor (0.0, 0.0, 0.0, 0.0);
+            glClear (GL_COLOR_BUFFER_BIT);
+            ImGui_ImplOpenGL3_RenderDrawData (ImGui::GetDrawData ());
+        }
+
+        /* Waits for vsync */
+        {
+            TRACE_ZONE ("swap");
+            SDL_GL_SwapWindow (window);
+        }
+
+        uint64_t frame_end = SDL_GetPerformanceCounter ();
+        hud_frame_ms [hud_frame_index] = (frame_end - frame_start) * 1000.0f / SDL_GetPerformanceFrequency ();
+        hud_frame_index = (hud_frame_index + 1) % HUD_HISTORY;
+        frame_start = frame_end;
+
+        /* Periodically compact the journal into the project file */
+        if (SDL_GetTicks () - autosave_last_compact > AUTOSAVE_INTERVAL_MS)
+        {
+            TRACE_ZONE ("autosave");
+            project_autosave ();
+            autosave_last_compact = SDL_GetTicks ();
+        }
     }
 
     return 0;
@@ -368,6 +3064,33 @@ int main_gui_loop (void)
  */
 int main (int argc, char **argv)
 {
+    trace_thread_name ("UI");
+
+    /* Record a trace from startup until exit: --trace <file> */
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp (argv [i], "--trace") == 0)
+        {
+            trace_path = argv [i + 1];
+            trace_start ();
+        }
+    }
+
+    /* Headless benchmark: --benchmark-ui <frames> [--gl] [--json] */
+    if (argc >= 3 && strcmp (argv [1], "--benchmark-ui") == 0)
+    {
+        bool use_gl = false;
+        bool json = false;
+
+        for (int i = 3; i < argc; i++)
+        {
+            use_gl |= strcmp (argv [i], "--gl") == 0;
+            json |= strcmp (argv [i], "--json") == 0;
+        }
+
+        return benchmark_ui (std::max (1, atoi (argv [2])), use_gl, json);
+    }
+
     if (SDL_Init (SDL_INIT_EVERYTHING) == -1)
     {
         fprintf (stderr, "SDL_Init failure: %s\n", SDL_GetError ());
@@ -413,6 +3136,18 @@ int main (int argc, char **argv)
     ImGui_ImplSDL2_InitForOpenGL (window, gl_context);
     ImGui_ImplOpenGL3_Init ();
 
+    /* Texture for the VDP preview */
+    glGenTextures (1, &vdp_texture);
+    glBindTexture (GL_TEXTURE_2D, vdp_texture);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, VDP_WIDTH, VDP_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    /* Atlas of every tile in the store, for thumbnails */
+    tile_atlas_init (&tile_atlas, false);
+    mip_init (&map_mip, false);
+    document_init ();
+
     /* Style */
     ImGui::GetStyle ().FrameRounding = 2.0f;
 
@@ -422,8 +3157,48 @@ int main (int argc, char **argv)
         sprintf (tile_strings [i], "##%02x", i);
     }
 
+    jobs_init (0);
+
+    vram_layout_init (&vram_layout);
+
+    /* Restore the previous session */
+    autosave_directory = SDL_GetPrefPath ("JoppyFurr", "Snepsprite");
+    if (autosave_directory != NULL)
+    {
+        std::vector<uint8_t> snapshot;
+        uint32_t version;
+
+        if (journal_load_project (autosave_directory, &snapshot, &version))
+        {
+            project_restore (snapshot, version);
+        }
+
+        /* Unsaved edits in the journal mean the last session crashed */
+        autosave_dirty = journal_replay (autosave_directory, project_apply_edit) > 0;
+        journal_open (autosave_directory);
+        project_autosave ();
+    }
+
     main_gui_loop ();
 
+    jobs_shutdown ();
+
+    if (trace_recording ())
+    {
+        trace_save ();
+    }
+
+    if (autosave_directory != NULL)
+    {
+        project_autosave ();
+        journal_close ();
+        SDL_free (autosave_directory);
+    }
+
+    glDeleteTextures (1, &vdp_texture);
+    document_free_all ();
+    tile_atlas_free (&tile_atlas);
+    mip_free (&map_mip);
     ImGui_ImplOpenGL3_Shutdown ();
     ImGui_ImplSDL2_Shutdown ();
     ImGui::DestroyContext ();
@@ -0,0 +1,192 @@
+/*
+ * Metasprite decomposition.
+ *
+ * A drawn image is split into horizontal bands, one sprite high. Within a
+ * band, placing each sprite at the leftmost column not yet covered gives the
+ * fewest sprites for that band. Where the bands start is tried at every
+ * vertical phase and the best kept.
+ *
+ * This is a heuristic rather than an optimal cover: every sprite in a band
+ * shares its y, so a shape whose columns would be better served by sprites
+ * at differing heights may take more sprites than necessary.
+ *
+ * As the bands do not overlap, the sprites on any line are exactly those
+ * of its band, so no line carries more sprites than its band needs.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "tile_store.h"
+#include "metasprite.h"
+
+
+/*
+ * Place sprites for one choice of band phase.
+ * Returns the number of sprites, and the most in any band through max_line.
+ */
+static uint32_t decompose_phase (const uint8_t *canvas, uint32_t width, uint32_t height, int32_t band_height,
+                                 int32_t phase, std::vector<Metasprite_Entry> *entries, uint32_t *max_line)
+{
+    *max_line = 0;
+    entries->clear ();
+
+    for (int32_t top = -phase; top < (int32_t) height; top += band_height)
+    {
+        bool occupied [METASPRITE_CANVAS_MAX] = { false };
+        uint32_t band = 0;
+
+        for (int32_t y = std::max (top, 0); y < std::min (top + band_height, (int32_t) height); y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                occupied [x] |= canvas [x + y * width] != 0;
+            }
+        }
+
+        for (uint32_t x = 0; x < width; x++)
+        {
+            if (!occupied [x])
+            {
+                continue;
+            }
+
+            /* Pull sprites at the right edge back inside the canvas, nothing to their right needs covering */
+            Metasprite_Entry entry;
+            entry.x = (width >= 8) ? std::min (x, width - 8) : 0;
+            entry.y = top;
+            entry.pattern = 0;
+            entries->push_back (entry);
+            band++;
+
+            x = entry.x + 7;
+        }
+
+        *max_line = std::max (*max_line, band);
+    }
+
+    return entries->size ();
+}
+
+
+/*
+ * Split an indexed canvas into hardware sprites.
+ */
+uint32_t metasprite_decompose (const uint8_t *canvas, uint32_t width, uint32_t height, bool tall,
+                               Tile_Store *store, Metasprite *metasprite)
+{
+    std::vector<Metasprite_Entry> best;
+    std::vector<Metasprite_Entry> entries;
+    uint32_t best_max_line = 0;
+    int32_t sprite_height = tall ? 16 : 8;
+
+    width = std::min (width, (uint32_t) METASPRITE_CANVAS_MAX);
+
+    for (int32_t phase = 0; phase < sprite_height; phase++)
+    {
+        uint32_t max_line;
+        uint32_t count = decompose_phase (canvas, width, height, sprite_height, phase, &entries, &max_line);
+
+        if (phase == 0 || count < best.size () || (count == best.size () && max_line < best_max_line))
+        {
+            best.swap (entries);
+            best_max_line = max_line;
+        }
+    }
+
+    /* Cut the tiles out of the canvas */
+    for (Metasprite_Entry &entry : best)
+    {
+        Tile tile [2];
+
+        for (int32_t y = 0; y < sprite_height; y++)
+        {
+            for (int32_t x = 0; x < 8; x++)
+            {
+                int32_t canvas_x = entry.x + x;
+                int32_t canvas_y = entry.y + y;
+                bool inside = canvas_x < (int32_t) width && canvas_y >= 0 && canvas_y < (int32_t) height;
+
+                tile [y / 8].pixel [x + (y % 8) * 8] = inside ? canvas [canvas_x + canvas_y * width] : 0;
+            }
+        }
+
+        tile_encode_planar (tile [0].pixel, tile [0].planar);
+        if (tall)
+        {
+            tile_encode_planar (tile [1].pixel, tile [1].planar);
+            entry.pattern = tile_store_add_pair (store, &tile [0], &tile [1]);
+        }
+        else
+        {
+            entry.pattern = tile_store_add (store, &tile [0], tile_hash (tile [0].pixel));
+        }
+        entry.x -= metasprite->origin_x;
+        entry.y -= metasprite->origin_y;
+    }
+
+    metasprite->entries.swap (best);
+    metasprite->tall = tall;
+
+    return best_max_line;
+}
+
+
+/*
+ * Count the sprites covering each line of the canvas.
+ */
+void metasprite_line_counts (const Metasprite *metasprite, uint32_t height, uint8_t *counts)
+{
+    for (uint32_t line = 0; line < height; line++)
+    {
+        int32_t y = (int32_t) line - metasprite->origin_y;
+        int32_t sprite_height = metasprite->tall ? 16 : 8;
+        uint32_t count = 0;
+
+        for (const Metasprite_Entry &entry : metasprite->entries)
+        {
+            count += (y >= entry.y && y < entry.y + sprite_height);
+        }
+
+        counts [line] = std::min (count, 255u);
+    }
+}
+
+
+/*
+ * Export the sprite offset tables to stdout.
+ */
+void metasprite_export (const Metasprite *metasprite, const char *label)
+{
+    uint32_t count = metasprite->entries.size ();
+
+    printf ("/* %u sprites, %s */\n", count, metasprite->tall ? "8×16" : "8×8");
+
+    printf ("const int8_t %s_y [] = {", label);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        printf (i ? ", %d" : " %d", metasprite->entries [i].y);
+    }
+    printf (" };\n");
+
+    printf ("const int8_t %s_x [] = {", label);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        printf (i ? ", %d" : " %d", metasprite->entries [i].x);
+    }
+    printf (" };\n");
+
+    printf ("const uint8_t %s_pattern [] = {", label);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (metasprite->entries [i].pattern > 255)
+        {
+            fprintf (stderr, "Warning: sprite pattern %u is beyond the 256 sprite patterns.\n",
+                     metasprite->entries [i].pattern);
+        }
+        printf (i ? ", %u" : " %u", metasprite->entries [i].pattern & 0xff);
+    }
+    printf (" };\n");
+}
@@ -0,0 +1,38 @@
+#pragma once
+/*
+ * Metasprite API.
+ */
+
+#include <stdint.h>
+
+#include <vector>
+
+typedef struct Tile_Store_s Tile_Store;
+
+#define METASPRITE_CANVAS_MAX   64  /* Largest canvas, in pixels along each axis */
+
+typedef struct Metasprite_Entry_s {
+    int16_t x;          /* Offset from the metasprite's origin */
+    int16_t y;
+    uint16_t pattern;   /* Tile store index */
+} Metasprite_Entry;
+
+typedef struct Metasprite_s {
+    std::vector<Metasprite_Entry> entries;
+    int16_t origin_x;   /* Anchor point, relative to the top-left of the canvas */
+    int16_t origin_y;
+    bool tall;          /* 8×16 sprites */
+} Metasprite;
+
+/* Split an indexed canvas into 8×8 or 8×16 hardware sprites, in bands one sprite high,
+ * choosing the band offset that needs the fewest sprites and then the fewest per line.
+ * Colour 0 is transparent. Sprite tiles are added to the store. Returns the most sprites
+ * on any one line. */
+uint32_t metasprite_decompose (const uint8_t *canvas, uint32_t width, uint32_t height, bool tall,
+                               Tile_Store *store, Metasprite *metasprite);
+
+/* Count the sprites covering each line of the canvas. */
+void metasprite_line_counts (const Metasprite *metasprite, uint32_t height, uint8_t *counts);
+
+/* Export the sprite offset tables to stdout. */
+void metasprite_export (const Metasprite *metasprite, const char *label);
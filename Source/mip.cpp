@@ -0,0 +1,341 @@
+/*
+ * Indexed mip chain.
+ *
+ * Downsampled copies of an indexed image, for viewing large tile maps when
+ * zoomed out. Each level halves the one below, keeping the most common of
+ * each 2×2 block of palette indices rather than blending, so that pixel art
+ * stays crisp and the levels do not depend on the palette. Changing part of
+ * level zero only recomputes the blocks above it, and only the changed rows
+ * of a level are uploaded when it is next drawn. The levels are not allocated
+ * until the chain is first drawn into, so an unviewed chain costs no memory.
+ * Levels larger than GL_MAX_TEXTURE_SIZE are never made into textures.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <GL/gl3w.h>
+
+#include "imgui.h"
+#include "tile_store.h"
+#include "colour.h"
+#include "mip.h"
+
+
+/*
+ * Create an empty chain.
+ */
+void mip_init (Mip_Chain *chain, bool headless)
+{
+    chain->headless = headless;
+    chain->max_size = UINT32_MAX;
+    if (!headless)
+    {
+        GLint max_size = 0;
+        glGetIntegerv (GL_MAX_TEXTURE_SIZE, &max_size);
+        chain->max_size = std::max (max_size, 1);
+    }
+    memset (chain->texture, 0, sizeof (chain->texture));
+    memset (chain->palette, 0, sizeof (chain->palette));
+    std::fill_n (chain->colour, 16, IM_COL32 (0, 0, 0, 255));
+    chain->upload_bytes = 0;
+
+    mip_resize (chain, 0, 0);
+}
+
+
+/*
+ * Delete the textures.
+ */
+void mip_free (Mip_Chain *chain)
+{
+    for (uint32_t level = 0; level < MIP_LEVELS_MAX; level++)
+    {
+        if (chain->texture [level] != 0)
+        {
+            GLuint texture = chain->texture [level];
+            glDeleteTextures (1, &texture);
+            chain->texture [level] = 0;
+        }
+    }
+}
+
+
+/*
+ * Resize the chain, clearing every level.
+ */
+void mip_resize (Mip_Chain *chain, uint32_t width, uint32_t height)
+{
+    mip_free (chain);
+
+    chain->levels = 0;
+    while (chain->levels < MIP_LEVELS_MAX)
+    {
+        uint32_t level = chain->levels++;
+
+        chain->width [level] = width;
+        chain->height [level] = height;
+        std::vector<uint8_t> ().swap (chain->pixel [level]);
+        chain->dirty_top [level] = 0;
+        chain->dirty_bottom [level] = height;
+
+        if (width <= 1 && height <= 1)
+        {
+            break;
+        }
+
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    for (uint32_t level = chain->levels; level < MIP_LEVELS_MAX; level++)
+    {
+        std::vector<uint8_t> ().swap (chain->pixel [level]);
+    }
+}
+
+
+/*
+ * Allocate the levels, cleared to index zero, if they have not been already.
+ */
+static void mip_allocate (Mip_Chain *chain)
+{
+    if (chain->levels == 0 || chain->pixel [0].size () == (size_t) chain->width [0] * chain->height [0])
+    {
+        return;
+    }
+
+    for (uint32_t level = 0; level < chain->levels; level++)
+    {
+        chain->pixel [level].assign ((size_t) chain->width [level] * chain->height [level], 0);
+    }
+}
+
+
+/*
+ * Set the palette, recolouring every level when it is next drawn.
+ */
+void mip_set_palette (Mip_Chain *chain, const uint8_t *colours)
+{
+    if (memcmp (chain->palette, colours, sizeof (chain->palette)) == 0)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        uint8_t rgb [3];
+        sms_colour_rgb (colours [i], rgb);
+        chain->colour [i] = IM_COL32 (rgb [0], rgb [1], rgb [2], 255);
+    }
+    memcpy (chain->palette, colours, sizeof (chain->palette));
+
+    for (uint32_t level = 0; level < chain->levels; level++)
+    {
+        chain->dirty_top [level] = 0;
+        chain->dirty_bottom [level] = chain->height [level];
+    }
+}
+
+
+/*
+ * The most common of four indices, preferring the earlier on a tie.
+ */
+static inline uint8_t mip_mode (uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+    if (a == b || a == c || a == d)
+    {
+        return a;
+    }
+    if (b == c || b == d)
+    {
+        return b;
+    }
+    if (c == d)
+    {
+        return c;
+    }
+
+    return a;
+}
+
+
+/*
+ * Extend a level's range of rows to upload.
+ */
+static void mip_mark_dirty (Mip_Chain *chain, uint32_t level, uint32_t top, uint32_t bottom)
+{
+    if (chain->dirty_top [level] >= chain->dirty_bottom [level])
+    {
+        chain->dirty_top [level] = top;
+        chain->dirty_bottom [level] = bottom;
+    }
+    else
+    {
+        chain->dirty_top [level] = std::min (chain->dirty_top [level], top);
+        chain->dirty_bottom [level] = std::max (chain->dirty_bottom [level], bottom);
+    }
+}
+
+
+/*
+ * Recompute the levels above zero over a rectangle of level zero.
+ */
+void mip_update (Mip_Chain *chain, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    if (chain->levels == 0 || width == 0 || height == 0)
+    {
+        return;
+    }
+    mip_allocate (chain);
+
+    /* The rectangle, as [x0, x1) × [y0, y1) in the current level */
+    uint32_t x0 = x;
+    uint32_t y0 = y;
+    uint32_t x1 = std::min (x + width, chain->width [0]);
+    uint32_t y1 = std::min (y + height, chain->height [0]);
+
+    mip_mark_dirty (chain, 0, y0, y1);
+
+    for (uint32_t level = 1; level < chain->levels; level++)
+    {
+        const uint8_t *below = chain->pixel [level - 1].data ();
+        uint32_t below_width = chain->width [level - 1];
+        uint32_t below_height = chain->height [level - 1];
+        uint8_t *out = chain->pixel [level].data ();
+        uint32_t out_width = chain->width [level];
+
+        x0 = x0 / 2;
+        y0 = y0 / 2;
+        x1 = (x1 + 1) / 2;
+        y1 = (y1 + 1) / 2;
+
+        for (uint32_t out_y = y0; out_y < y1; out_y++)
+        {
+            /* Odd sizes repeat the last row or column */
+            const uint8_t *top = &below [out_y * 2 * below_width];
+            const uint8_t *bottom = (out_y * 2 + 1 < below_height) ? top + below_width : top;
+
+            for (uint32_t out_x = x0; out_x < x1; out_x++)
+            {
+                uint32_t left = out_x * 2;
+                uint32_t right = (left + 1 < below_width) ? left + 1 : left;
+
+                out [out_x + out_y * out_width] = mip_mode (top [left], top [right], bottom [left], bottom [right]);
+            }
+        }
+
+        mip_mark_dirty (chain, level, y0, y1);
+    }
+}
+
+
+/*
+ * Draw rows of a tile map into level zero, and update the levels above.
+ */
+void mip_load_map_rows (Mip_Chain *chain, const Tile_Map *map, const Tile_Store *store, uint32_t first, uint32_t count)
+{
+    static const uint8_t blank [64] = { 0 };
+    uint32_t width = chain->width [0];
+    count = std::min (count, map->height - std::min (first, map->height));
+    mip_allocate (chain);
+
+    for (uint32_t row = first; row < first + count; row++)
+    {
+        for (uint32_t column = 0; column < map->width; column++)
+        {
+            uint32_t entry = map->entry [column + row * map->width];
+            uint32_t index = entry & TILE_INDEX_MASK;
+            const uint8_t *pixel = (index < store->tiles.size ()) ? store->tiles [index].pixel : blank;
+            uint8_t *out = &chain->pixel [0][column * 8 + row * 8 * width];
+
+            for (uint32_t y = 0; y < 8; y++)
+            {
+                const uint8_t *in = &pixel [((entry & TILE_VFLIP) ? 7 - y : y) * 8];
+
+                for (uint32_t x = 0; x < 8; x++)
+                {
+                    out [x + y * width] = in [(entry & TILE_HFLIP) ? 7 - x : x] & 0x0f;
+                }
+            }
+        }
+    }
+
+    mip_update (chain, 0, first * 8, width, count * 8);
+}
+
+
+/*
+ * The first level small enough to be a texture.
+ */
+uint32_t mip_first_level (const Mip_Chain *chain)
+{
+    uint32_t level = 0;
+
+    while (level + 1 < chain->levels &&
+           (chain->width [level] > chain->max_size || chain->height [level] > chain->max_size))
+    {
+        level++;
+    }
+
+    return level;
+}
+
+
+/*
+ * Get the texture for a level, first uploading the rows that have changed.
+ */
+uint32_t mip_texture (Mip_Chain *chain, uint32_t level)
+{
+    if (level >= chain->levels || chain->width [level] > chain->max_size || chain->height [level] > chain->max_size)
+    {
+        return 0;
+    }
+
+    uint32_t width = chain->width [level];
+    uint32_t height = chain->height [level];
+    mip_allocate (chain);
+
+    if (!chain->headless && chain->texture [level] == 0 && width > 0 && height > 0)
+    {
+        GLuint texture;
+        glGenTextures (1, &texture);
+        glBindTexture (GL_TEXTURE_2D, texture);
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        chain->texture [level] = texture;
+        chain->dirty_top [level] = 0;
+        chain->dirty_bottom [level] = height;
+    }
+
+    uint32_t top = chain->dirty_top [level];
+    uint32_t bottom = std::min (chain->dirty_bottom [level], height);
+
+    if (top < bottom)
+    {
+        const uint8_t *pixel = &chain->pixel [level][top * width];
+        uint32_t count = (bottom - top) * width;
+
+        chain->rgba.resize (count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            chain->rgba [i] = chain->colour [pixel [i]];
+        }
+
+        if (chain->texture [level] != 0)
+        {
+            glBindTexture (GL_TEXTURE_2D, chain->texture [level]);
+            glTexSubImage2D (GL_TEXTURE_2D, 0, 0, top, width, bottom - top, GL_RGBA, GL_UNSIGNED_BYTE,
+                             chain->rgba.data ());
+        }
+
+        chain->upload_bytes += count * sizeof (uint32_t);
+        chain->dirty_top [level] = height;
+        chain->dirty_bottom [level] = 0;
+    }
+
+    return chain->texture [level];
+}
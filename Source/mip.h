@@ -0,0 +1,54 @@
+#pragma once
+/*
+ * Indexed mip chain API.
+ */
+
+#include <stdint.h>
+
+#include <vector>
+
+typedef struct Tile_Store_s Tile_Store;
+typedef struct Tile_Map_s Tile_Map;
+
+#define MIP_LEVELS_MAX 16
+
+typedef struct Mip_Chain_s {
+    bool headless;                                  /* No textures are created */
+    uint32_t max_size;                              /* GL_MAX_TEXTURE_SIZE */
+    uint32_t levels;
+    uint32_t width [MIP_LEVELS_MAX];
+    uint32_t height [MIP_LEVELS_MAX];
+    std::vector<uint8_t> pixel [MIP_LEVELS_MAX];    /* Palette indices, row-major */
+    uint32_t texture [MIP_LEVELS_MAX];              /* OpenGL texture for each level, created on first use */
+    uint32_t dirty_top [MIP_LEVELS_MAX];            /* Rows changed since the level's last upload */
+    uint32_t dirty_bottom [MIP_LEVELS_MAX];
+    uint8_t palette [16];
+    uint32_t colour [16];                           /* The palette as RGBA */
+    std::vector<uint32_t> rgba;                     /* Upload buffer */
+    uint32_t upload_bytes;                          /* Since last read by the caller */
+} Mip_Chain;
+
+/* Create an empty chain. Textures are only created if headless is not set. */
+void mip_init (Mip_Chain *chain, bool headless);
+
+/* Delete the textures. */
+void mip_free (Mip_Chain *chain);
+
+/* Resize the chain, clearing every level to index zero. The levels are allocated when next used. */
+void mip_resize (Mip_Chain *chain, uint32_t width, uint32_t height);
+
+/* Set the palette used to colour the textures. */
+void mip_set_palette (Mip_Chain *chain, const uint8_t *colours);
+
+/* Recompute the levels above zero over a rectangle of level zero, after its pixels have been changed. */
+void mip_update (Mip_Chain *chain, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+/* Draw rows of a tile map into level zero, and update the levels above. */
+void mip_load_map_rows (Mip_Chain *chain, const Tile_Map *map, const Tile_Store *store, uint32_t first, uint32_t count);
+
+/* The first level small enough to be a texture. Larger levels have no texture. */
+uint32_t mip_first_level (const Mip_Chain *chain);
+
+/* Get the texture for a level, first uploading any rows that have changed.
+ * Returns zero when headless, or if the level is too large to be a texture. */
+uint32_t mip_texture (Mip_Chain *chain, uint32_t level);
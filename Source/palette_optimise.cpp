@@ -0,0 +1,395 @@
+/*
+ * Palette optimiser.
+ *
+ * Picks the subset of the 64 SMS colours that minimises the total L*a*b*
+ * error over an image's colour histogram. A table of the error between every
+ * SMS colour and every histogram colour is computed up front. Colours are
+ * then chosen greedily, and refined by swapping chosen colours for unchosen
+ * ones until no single swap improves the result (k-medoids over the 64
+ * candidates).
+ *
+ * Locked entries keep their colour and index, and only the remaining
+ * entries are chosen. When several images share a palette, their
+ * histograms are summed so that the total error over all of them is
+ * minimised.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "colour.h"
+#include "jobs.h"
+#include "ppm.h"
+#include "trace.h"
+#include "palette_optimise.h"
+
+#define SWAP_ITERATIONS_MAX 64
+#define KERNEL_LANES 8
+
+typedef struct Histogram_Work_s {
+    Job *job;
+    Palette_Context *context;
+    uint32_t batch_size;                            /* Images per batch */
+    std::vector<std::vector<uint64_t>> histograms;  /* One per batch, so one per worker */
+    std::vector<std::string> errors;                /* One per image */
+} Histogram_Work;
+
+
+/*
+ * Add the colours of a PPM image to a 15-bit colour histogram, one row at a time.
+ */
+bool image_histogram_add (const char *path, uint64_t *histogram, std::string *error)
+{
+    uint32_t width;
+    uint32_t height;
+    TRACE_ZONE ("image_histogram_add");
+
+    FILE *file = ppm_open (path, &width, &height, error);
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> row (width * 3);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        if (fread (row.data (), 1, row.size (), file) != row.size ())
+        {
+            *error = "Image data is truncated";
+            fclose (file);
+            return false;
+        }
+
+        for (uint32_t x = 0; x < width; x++)
+        {
+            histogram [RGB15 (row [x * 3 + 0], row [x * 3 + 1], row [x * 3 + 2])]++;
+        }
+    }
+
+    fclose (file);
+    return true;
+}
+
+
+/*
+ * Total error if each histogram colour takes the lesser of two errors.
+ *
+ * Accumulated in independent lanes so that the compiler can vectorise the
+ * loop without reassociating floating point sums. count is padded to a
+ * multiple of KERNEL_LANES.
+ */
+static float error_sum_min (const float *a, const float *b, uint32_t count)
+{
+    float lane [KERNEL_LANES] = { 0 };
+
+    for (uint32_t n = 0; n < count; n += KERNEL_LANES)
+    {
+        for (uint32_t i = 0; i < KERNEL_LANES; i++)
+        {
+            lane [i] += std::min (a [n + i], b [n + i]);
+        }
+    }
+
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < KERNEL_LANES; i++)
+    {
+        sum += lane [i];
+    }
+
+    return sum;
+}
+
+
+/*
+ * Choose up to 16 of the 64 SMS colours to minimise the perceptual error.
+ */
+float palette_optimise (const uint64_t *histogram, uint8_t *palette, uint16_t locked, bool transparent)
+{
+    const float *rgb15_lab = colour_rgb15_lab ();
+    const float *sms_lab = colour_sms_lab ();
+    std::vector<uint32_t> colours;
+    double total_weight = 0.0;
+    TRACE_ZONE ("palette_optimise");
+
+    for (uint32_t rgb15 = 0; rgb15 < 32768; rgb15++)
+    {
+        if (histogram [rgb15])
+        {
+            colours.push_back (rgb15);
+            total_weight += histogram [rgb15];
+        }
+    }
+
+    if (transparent)
+    {
+        locked |= 0x0001;
+    }
+
+    if (colours.empty ())
+    {
+        return 0.0f;
+    }
+
+    /* Padding entries have zero weight, and so zero error */
+    uint32_t count = (colours.size () + KERNEL_LANES - 1) & ~(KERNEL_LANES - 1);
+
+    /* 64 × N weighted error table, one row per SMS colour */
+    std::vector<float> error (64 * count, 0.0f);
+    for (uint32_t c = 0; c < 64; c++)
+    {
+        float *row = &error [c * count];
+
+        for (uint32_t n = 0; n < colours.size (); n++)
+        {
+            row [n] = histogram [colours [n]] * colour_distance (&rgb15_lab [colours [n] * 3], &sms_lab [c * 3]);
+        }
+    }
+
+    /* Locked entries come first in the selection, and are never swapped out */
+    std::vector<uint8_t> selected;
+    std::vector<float> nearest (count, INFINITY);
+    std::fill (nearest.begin () + colours.size (), nearest.end (), 0.0f);
+    float cost = INFINITY;
+    bool chosen [64] = { false };
+    uint32_t slots = 16;
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        if (!(locked & (1 << i)))
+        {
+            continue;
+        }
+
+        uint8_t colour = palette [i] & 0x3f;
+        slots--;
+
+        /* The transparent entry is not matched against any pixel */
+        if ((transparent && i == 0) || chosen [colour])
+        {
+            continue;
+        }
+
+        selected.push_back (colour);
+        chosen [colour] = true;
+
+        for (uint32_t n = 0; n < count; n++)
+        {
+            nearest [n] = std::min (nearest [n], error [colour * count + n]);
+        }
+    }
+
+    uint32_t fixed_count = selected.size ();
+    if (fixed_count)
+    {
+        cost = error_sum_min (nearest.data (), nearest.data (), count);
+    }
+
+    /* Greedy selection */
+    while (selected.size () < fixed_count + slots)
+    {
+        float best_cost = cost;
+        int32_t best = -1;
+
+        for (uint32_t c = 0; c < 64; c++)
+        {
+            float candidate_cost;
+
+            if (chosen [c])
+            {
+                continue;
+            }
+
+            candidate_cost = error_sum_min (&error [c * count], nearest.data (), count);
+            if (candidate_cost < best_cost)
+            {
+                best_cost = candidate_cost;
+                best = c;
+            }
+        }
+
+        if (best < 0)
+        {
+            break;
+        }
+
+        selected.push_back (best);
+        chosen [best] = true;
+        cost = best_cost;
+
+        for (uint32_t n = 0; n < count; n++)
+        {
+            nearest [n] = std::min (nearest [n], error [best * count + n]);
+        }
+    }
+
+    /* Swap refinement */
+    std::vector<float> first (count);
+    std::vector<float> second (count);
+    std::vector<uint8_t> first_index (count);
+    std::vector<float> without (count);
+
+    for (uint32_t iteration = 0; iteration < SWAP_ITERATIONS_MAX && selected.size () > fixed_count; iteration++)
+    {
+        /* Nearest and second-nearest selected colour for each histogram entry */
+        std::fill (first.begin (), first.end (), INFINITY);
+        std::fill (second.begin (), second.end (), INFINITY);
+        for (uint32_t s = 0; s < selected.size (); s++)
+        {
+            const float *row = &error [selected [s] * count];
+
+            for (uint32_t n = 0; n < count; n++)
+            {
+                if (row [n] < first [n])
+                {
+                    second [n] = first [n];
+                    first [n] = row [n];
+                    first_index [n] = s;
+                }
+                else if (row [n] < second [n])
+                {
+                    second [n] = row [n];
+                }
+            }
+        }
+
+        float best_cost = cost * (1.0f - 1e-6f);
+        int32_t best_s = -1;
+        int32_t best_c = -1;
+
+        for (uint32_t s = fixed_count; s < selected.size (); s++)
+        {
+            /* Error for each entry with selected colour s removed */
+            for (uint32_t n = 0; n < count; n++)
+            {
+                without [n] = (first_index [n] == s) ? second [n] : first [n];
+            }
+
+            for (uint32_t c = 0; c < 64; c++)
+            {
+                if (chosen [c])
+                {
+                    continue;
+                }
+
+                float swap_cost = error_sum_min (&error [c * count], without.data (), count);
+                if (swap_cost < best_cost)
+                {
+                    best_cost = swap_cost;
+                    best_s = s;
+                    best_c = c;
+                }
+            }
+        }
+
+        if (best_s < 0)
+        {
+            break;
+        }
+
+        chosen [selected [best_s]] = false;
+        chosen [best_c] = true;
+        selected [best_s] = best_c;
+        cost = best_cost;
+    }
+
+    /* Fill the unlocked entries from dark to light */
+    std::sort (selected.begin () + fixed_count, selected.end (), [sms_lab] (uint8_t a, uint8_t b) {
+        return (sms_lab [a * 3] != sms_lab [b * 3]) ? sms_lab [a * 3] < sms_lab [b * 3] : a < b;
+    });
+
+    uint32_t next = fixed_count;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        if (!(locked & (1 << i)))
+        {
+            palette [i] = (next < selected.size ()) ? selected [next++] : 0x00;
+        }
+    }
+
+    return cost / total_weight;
+}
+
+
+/*
+ * Add a batch of images to the batch's histogram.
+ */
+static void palette_histogram_images (void *data, uint32_t begin, uint32_t end)
+{
+    Histogram_Work *work = (Histogram_Work *) data;
+    std::vector<uint64_t> &histogram = work->histograms [begin / work->batch_size];
+    TRACE_ZONE ("histogram_images");
+
+    histogram.assign (32768, 0);
+
+    for (uint32_t i = begin; i < end && !job_cancelled (work->job); i++)
+    {
+        image_histogram_add (work->context->paths [i].c_str (), histogram.data (), &work->errors [i]);
+        work->job->progress++;
+    }
+}
+
+
+/*
+ * Job function: choose one palette shared by every image in the Palette_Context in job->data.
+ */
+void palette_optimise_run (Job *job)
+{
+    Palette_Context *context = (Palette_Context *) job->data;
+    std::vector<uint64_t> histogram (32768, 0);
+    Histogram_Work work;
+
+    context->success = false;
+
+    if (context->paths.empty ())
+    {
+        context->error = "No images given";
+        return;
+    }
+
+    /* Split the images into one batch per worker, each with its own histogram */
+    uint32_t count = context->paths.size ();
+    uint32_t batches = std::min (count, jobs_worker_count ());
+
+    work.job = job;
+    work.context = context;
+    work.batch_size = (count + batches - 1) / batches;
+    work.histograms.resize ((count + work.batch_size - 1) / work.batch_size);
+    work.errors.resize (count);
+    job_set_progress (job, 0, count + 1);
+
+    jobs_parallel_for (count, work.batch_size, palette_histogram_images, &work);
+
+    if (job_cancelled (job))
+    {
+        context->error = "Cancelled";
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!work.errors [i].empty ())
+        {
+            context->error = context->paths [i] + ": " + work.errors [i];
+            return;
+        }
+    }
+
+    /* Sum the batches, so that the total error over every image is minimised */
+    for (const std::vector<uint64_t> &batch : work.histograms)
+    {
+        for (uint32_t rgb15 = 0; rgb15 < 32768; rgb15++)
+        {
+            histogram [rgb15] += batch [rgb15];
+        }
+    }
+
+    context->palette_error = palette_optimise (histogram.data (), context->palette,
+                                               context->locked, context->transparent);
+    job->progress++;
+    context->success = true;
+}
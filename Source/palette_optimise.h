@@ -0,0 +1,34 @@
+#pragma once
+/*
+ * Palette optimiser API.
+ */
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+typedef struct Job_s Job;
+
+typedef struct Palette_Context_s {
+    /* Options */
+    std::vector<std::string> paths;
+    uint8_t palette [16];   /* Locked entries are kept, the rest are replaced */
+    uint16_t locked;        /* Bit n keeps palette [n] */
+    bool transparent;       /* Index 0 is transparent, so is kept but not used for any pixel */
+
+    /* Results */
+    bool success;
+    std::string error;
+    float palette_error;
+} Palette_Context;
+
+/* Add the colours of a PPM image to a 15-bit colour histogram. */
+bool image_histogram_add (const char *path, uint64_t *histogram, std::string *error);
+
+/* Choose up to 16 of the 64 SMS colours to minimise the perceptual error
+ * over a 15-bit colour histogram. Returns the mean squared error per pixel. */
+float palette_optimise (const uint64_t *histogram, uint8_t *palette, uint16_t locked, bool transparent);
+
+/* Job function: choose one palette shared by every image in the Palette_Context in job->data. */
+void palette_optimise_run (Job *job);
@@ -0,0 +1,104 @@
+/*
+ * PPM image reader.
+ *
+ * Only the header is parsed here. Pixel data is left for the caller to
+ * read a few rows at a time.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ppm.h"
+
+
+/*
+ * Read the next whitespace-delimited number from a PPM header, skipping comments.
+ */
+static bool ppm_read_number (FILE *file, uint32_t *value)
+{
+    int c = fgetc (file);
+
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#')
+    {
+        if (c == '#')
+        {
+            while (c != '\n' && c != EOF)
+            {
+                c = fgetc (file);
+            }
+        }
+        c = fgetc (file);
+    }
+
+    if (c < '0' || c > '9')
+    {
+        return false;
+    }
+
+    *value = 0;
+    while (c >= '0' && c <= '9')
+    {
+        *value = (*value * 10) + (c - '0');
+        c = fgetc (file);
+    }
+
+    /* A single whitespace character follows each field */
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+/*
+ * Read the header of a binary PPM file, leaving the file positioned at the pixel data.
+ */
+static bool ppm_read_header (FILE *file, uint32_t *width, uint32_t *height, std::string *error)
+{
+    uint32_t maxval;
+
+    if (fgetc (file) != 'P' || fgetc (file) != '6')
+    {
+        *error = "Not a binary PPM (P6) file";
+        return false;
+    }
+
+    if (!ppm_read_number (file, width) || !ppm_read_number (file, height) || !ppm_read_number (file, &maxval))
+    {
+        *error = "Malformed PPM header";
+        return false;
+    }
+
+    if (maxval != 255)
+    {
+        *error = "Only 8-bit PPM files are supported";
+        return false;
+    }
+
+    if (*width == 0 || *height == 0 || *width > 65536 || *height > 65536)
+    {
+        *error = "Unsupported image dimensions";
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Open a binary PPM file.
+ */
+FILE *ppm_open (const char *path, uint32_t *width, uint32_t *height, std::string *error)
+{
+    FILE *file = fopen (path, "rb");
+    if (file == NULL)
+    {
+        *error = std::string ("Unable to open ") + path;
+        return NULL;
+    }
+
+    if (!ppm_read_header (file, width, height, error))
+    {
+        fclose (file);
+        return NULL;
+    }
+
+    return file;
+}
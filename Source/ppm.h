@@ -0,0 +1,13 @@
+#pragma once
+/*
+ * PPM image reader API.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+/* Open a binary PPM (P6) file, leaving it positioned at the first row of pixel data.
+ * Returns NULL and sets error on failure. */
+FILE *ppm_open (const char *path, uint32_t *width, uint32_t *height, std::string *error);
@@ -0,0 +1,341 @@
+/*
+ * Tile atlas.
+ *
+ * A cache of tile images in a single texture, so that grids of tiles need no
+ * texture switches. Each 8×8 slot holds one tile drawn with one palette, and
+ * is filled on first use. When every slot is taken, the least recently used
+ * slot is reused. Flips are handled by swapping texture coordinates, so the
+ * flipped forms of a tile share its slot.
+ *
+ * Slots drawn during a frame are uploaded by tile_atlas_flush () as runs of
+ * whole rows. Changing a palette entry only redraws the cached tiles that
+ * use it. The texture and its copy are only created once the first tile is
+ * drawn, so an atlas that is never shown costs no memory.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <GL/gl3w.h>
+
+#include "imgui.h"
+#include "tile_store.h"
+#include "colour.h"
+#include "tile_atlas.h"
+
+
+/*
+ * Start an empty atlas.
+ */
+void tile_atlas_init (Tile_Atlas *atlas, bool headless)
+{
+    atlas->headless = headless;
+    atlas->texture = 0;
+    atlas->pixels.clear ();
+    atlas->slots.clear ();
+    atlas->slot_of.clear ();
+    memset (atlas->palette, 0, sizeof (atlas->palette));
+    memset (atlas->row_dirty, 0, sizeof (atlas->row_dirty));
+    atlas->frame = 1;
+    atlas->upload_bytes = 0;
+    atlas->drawn = 0;
+    atlas->evicted = 0;
+    atlas->dropped = 0;
+
+    for (uint32_t i = 0; i < TILE_ATLAS_PALETTES; i++)
+    {
+        std::fill_n (atlas->colour [i], 16, IM_COL32 (0, 0, 0, 255));
+    }
+}
+
+
+/*
+ * Create the slots and the texture, on first use.
+ */
+static void tile_atlas_create (Tile_Atlas *atlas)
+{
+    atlas->pixels.assign (TILE_ATLAS_SIZE * TILE_ATLAS_SIZE, 0);
+    atlas->slots.resize (TILE_ATLAS_CAPACITY);
+
+    /* Every slot starts free, in one list */
+    for (uint32_t s = 0; s < TILE_ATLAS_CAPACITY; s++)
+    {
+        Tile_Atlas_Slot *slot = &atlas->slots [s];
+        slot->key = TILE_ATLAS_NONE;
+        slot->last_used = 0;
+        slot->prev = (s > 0) ? s - 1 : TILE_ATLAS_NONE;
+        slot->next = (s + 1 < TILE_ATLAS_CAPACITY) ? s + 1 : TILE_ATLAS_NONE;
+        slot->colours = 0;
+        slot->stale = false;
+    }
+    atlas->lru_head = 0;
+    atlas->lru_tail = TILE_ATLAS_CAPACITY - 1;
+
+    if (atlas->headless)
+    {
+        return;
+    }
+
+    GLuint texture;
+    glGenTextures (1, &texture);
+    glBindTexture (GL_TEXTURE_2D, texture);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, TILE_ATLAS_SIZE, TILE_ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                  atlas->pixels.data ());
+    atlas->texture = texture;
+}
+
+
+/*
+ * Delete the texture and the slots.
+ */
+void tile_atlas_free (Tile_Atlas *atlas)
+{
+    if (atlas->texture != 0)
+    {
+        GLuint texture = atlas->texture;
+        glDeleteTextures (1, &texture);
+        atlas->texture = 0;
+    }
+
+    std::vector<uint32_t> ().swap (atlas->pixels);
+    std::vector<Tile_Atlas_Slot> ().swap (atlas->slots);
+    std::vector<uint32_t> ().swap (atlas->slot_of);
+    memset (atlas->row_dirty, 0, sizeof (atlas->row_dirty));
+}
+
+
+/*
+ * Set one of the palettes.
+ */
+void tile_atlas_set_palette (Tile_Atlas *atlas, uint32_t palette, const uint8_t *colours)
+{
+    uint16_t changed = 0;
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        if (atlas->palette [palette][i] != colours [i])
+        {
+            uint8_t rgb [3];
+            sms_colour_rgb (colours [i], rgb);
+            atlas->colour [palette][i] = IM_COL32 (rgb [0], rgb [1], rgb [2], 255);
+            atlas->palette [palette][i] = colours [i];
+            changed |= 1 << i;
+        }
+    }
+
+    if (changed == 0)
+    {
+        return;
+    }
+
+    for (Tile_Atlas_Slot &slot : atlas->slots)
+    {
+        if (slot.key != TILE_ATLAS_NONE && slot.key % TILE_ATLAS_PALETTES == palette && (slot.colours & changed))
+        {
+            slot.stale = true;
+        }
+    }
+}
+
+
+/*
+ * Forget every cached tile.
+ */
+void tile_atlas_invalidate (Tile_Atlas *atlas)
+{
+    for (Tile_Atlas_Slot &slot : atlas->slots)
+    {
+        slot.key = TILE_ATLAS_NONE;
+    }
+
+    std::fill (atlas->slot_of.begin (), atlas->slot_of.end (), TILE_ATLAS_NONE);
+}
+
+
+/*
+ * Move a slot to the front of the LRU list.
+ */
+static void tile_atlas_touch (Tile_Atlas *atlas, uint32_t s)
+{
+    Tile_Atlas_Slot *slot = &atlas->slots [s];
+
+    if (atlas->lru_head == s)
+    {
+        return;
+    }
+
+    /* Unlink */
+    atlas->slots [slot->prev].next = slot->next;
+    if (slot->next != TILE_ATLAS_NONE)
+    {
+        atlas->slots [slot->next].prev = slot->prev;
+    }
+    else
+    {
+        atlas->lru_tail = slot->prev;
+    }
+
+    /* Relink at the head */
+    slot->prev = TILE_ATLAS_NONE;
+    slot->next = atlas->lru_head;
+    atlas->slots [atlas->lru_head].prev = s;
+    atlas->lru_head = s;
+}
+
+
+/*
+ * Draw a tile into its slot.
+ */
+static void tile_atlas_rasterise (Tile_Atlas *atlas, uint32_t s, const Tile *tile, uint32_t palette)
+{
+    uint32_t row = s / TILE_ATLAS_COLUMNS;
+    uint32_t *out = &atlas->pixels [(s % TILE_ATLAS_COLUMNS) * 8 + row * 8 * TILE_ATLAS_SIZE];
+    const uint32_t *colour = atlas->colour [palette];
+    uint16_t colours = 0;
+
+    for (uint32_t y = 0; y < 8; y++)
+    {
+        for (uint32_t x = 0; x < 8; x++)
+        {
+            uint8_t value = tile->pixel [x + y * 8] & 0x0f;
+            out [x + y * TILE_ATLAS_SIZE] = colour [value];
+            colours |= 1 << value;
+        }
+    }
+
+    atlas->slots [s].colours = colours;
+    atlas->slots [s].stale = false;
+    atlas->row_dirty [row] = 1;
+    atlas->drawn++;
+}
+
+
+/*
+ * Find the slot holding a tile, drawing it into the least recently used slot if it is not cached.
+ * Returns TILE_ATLAS_NONE if every slot has already been used this frame.
+ */
+static uint32_t tile_atlas_lookup (Tile_Atlas *atlas, const Tile_Store *store, uint32_t tile, uint32_t palette)
+{
+    uint32_t key = tile * TILE_ATLAS_PALETTES + palette;
+
+    if (atlas->slots.empty ())
+    {
+        tile_atlas_create (atlas);
+    }
+
+    if (key >= atlas->slot_of.size ())
+    {
+        atlas->slot_of.resize (std::max ((size_t) store->tiles.size () * TILE_ATLAS_PALETTES, (size_t) key + 1),
+                               TILE_ATLAS_NONE);
+    }
+
+    uint32_t s = atlas->slot_of [key];
+
+    if (s == TILE_ATLAS_NONE)
+    {
+        s = atlas->lru_tail;
+        Tile_Atlas_Slot *victim = &atlas->slots [s];
+
+        if (victim->key != TILE_ATLAS_NONE)
+        {
+            if (victim->last_used == atlas->frame)
+            {
+                atlas->dropped++;
+                return TILE_ATLAS_NONE;
+            }
+
+            atlas->slot_of [victim->key] = TILE_ATLAS_NONE;
+            atlas->evicted++;
+        }
+
+        victim->key = key;
+        victim->stale = true;
+        atlas->slot_of [key] = s;
+    }
+
+    tile_atlas_touch (atlas, s);
+    atlas->slots [s].last_used = atlas->frame;
+
+    if (atlas->slots [s].stale)
+    {
+        tile_atlas_rasterise (atlas, s, &store->tiles [tile], palette);
+    }
+
+    return s;
+}
+
+
+/*
+ * Draw a tile from the store as a size × size square.
+ */
+void tile_atlas_draw (ImDrawList *draw_list, Tile_Atlas *atlas, const Tile_Store *store,
+                      uint32_t tile, uint32_t palette, uint32_t flip, float x, float y, float size)
+{
+    if (tile >= store->tiles.size ())
+    {
+        return;
+    }
+
+    uint32_t s = tile_atlas_lookup (atlas, store, tile, palette);
+    if (s == TILE_ATLAS_NONE)
+    {
+        return;
+    }
+
+    ImVec2 uv_min ((s % TILE_ATLAS_COLUMNS) * (8.0f / TILE_ATLAS_SIZE), (s / TILE_ATLAS_COLUMNS) * (8.0f / TILE_ATLAS_SIZE));
+    ImVec2 uv_max (uv_min.x + 8.0f / TILE_ATLAS_SIZE, uv_min.y + 8.0f / TILE_ATLAS_SIZE);
+
+    if (flip & TILE_HFLIP)
+    {
+        std::swap (uv_min.x, uv_max.x);
+    }
+    if (flip & TILE_VFLIP)
+    {
+        std::swap (uv_min.y, uv_max.y);
+    }
+
+    draw_list->AddImage ((void *) (intptr_t) atlas->texture, ImVec2 (x, y), ImVec2 (x + size, y + size), uv_min, uv_max);
+}
+
+
+/*
+ * Upload the rows of slots drawn this frame, merging neighbouring rows into one upload.
+ */
+void tile_atlas_flush (Tile_Atlas *atlas)
+{
+    atlas->upload_bytes = 0;
+    atlas->drawn = 0;
+    atlas->evicted = 0;
+    atlas->dropped = 0;
+
+    for (uint32_t row = 0; row < TILE_ATLAS_COLUMNS; row++)
+    {
+        if (!atlas->row_dirty [row])
+        {
+            continue;
+        }
+
+        uint32_t rows = 1;
+        while (row + rows < TILE_ATLAS_COLUMNS && atlas->row_dirty [row + rows])
+        {
+            rows++;
+        }
+
+        if (atlas->texture != 0)
+        {
+            glBindTexture (GL_TEXTURE_2D, atlas->texture);
+            glTexSubImage2D (GL_TEXTURE_2D, 0, 0, row * 8, TILE_ATLAS_SIZE, rows * 8, GL_RGBA, GL_UNSIGNED_BYTE,
+                             &atlas->pixels [row * 8 * TILE_ATLAS_SIZE]);
+        }
+
+        memset (&atlas->row_dirty [row], 0, rows);
+        atlas->upload_bytes += rows * 8 * TILE_ATLAS_SIZE * sizeof (uint32_t);
+        row += rows;
+    }
+
+    atlas->frame++;
+}
@@ -0,0 +1,68 @@
+#pragma once
+/*
+ * Tile atlas API.
+ */
+
+#include <stdint.h>
+
+#include <vector>
+
+#define TILE_ATLAS_SIZE     2048    /* Texture width and height, in pixels */
+#define TILE_ATLAS_COLUMNS  (TILE_ATLAS_SIZE / 8)
+#define TILE_ATLAS_CAPACITY (TILE_ATLAS_COLUMNS * TILE_ATLAS_COLUMNS)
+#define TILE_ATLAS_PALETTES 4       /* The editor only uses palette 0 so far */
+#define TILE_ATLAS_NONE     0xffffffff
+
+struct ImDrawList;
+typedef struct Tile_Store_s Tile_Store;
+
+typedef struct Tile_Atlas_Slot_s {
+    uint32_t key;           /* tile * TILE_ATLAS_PALETTES + palette, or TILE_ATLAS_NONE if free */
+    uint32_t last_used;     /* Frame the slot was last drawn in */
+    uint32_t prev;          /* LRU list, most recently used first */
+    uint32_t next;
+    uint16_t colours;       /* Palette entries used by the tile */
+    bool stale;             /* Tile or palette has changed since the slot was drawn */
+} Tile_Atlas_Slot;
+
+typedef struct Tile_Atlas_s {
+    bool headless;                          /* No texture is created */
+    uint32_t texture;                       /* OpenGL texture, created with the first tile drawn */
+    std::vector<uint32_t> pixels;           /* RGBA copy of the texture */
+    std::vector<Tile_Atlas_Slot> slots;
+    std::vector<uint32_t> slot_of;          /* Key -> slot, or TILE_ATLAS_NONE */
+    uint32_t lru_head;
+    uint32_t lru_tail;                      /* Evicted first */
+    uint8_t palette [TILE_ATLAS_PALETTES][16];
+    uint32_t colour [TILE_ATLAS_PALETTES][16];  /* The palettes as RGBA */
+    uint8_t row_dirty [TILE_ATLAS_COLUMNS]; /* Rows of slots to upload at the next flush */
+    uint32_t frame;
+
+    /* Statistics, counted since the last flush */
+    uint32_t drawn;         /* Tiles rasterised into a slot */
+    uint32_t evicted;
+    uint32_t dropped;       /* Not drawn, as every slot was already in use this frame */
+    uint32_t upload_bytes;  /* By the last flush */
+} Tile_Atlas;
+
+/* Start an empty atlas. The texture is created when the first tile is drawn, which
+ * needs a current OpenGL context unless headless is set. */
+void tile_atlas_init (Tile_Atlas *atlas, bool headless);
+
+/* Delete the texture and the slots. They are created again if another tile is drawn. */
+void tile_atlas_free (Tile_Atlas *atlas);
+
+/* Set one of the palettes, redrawing only the cached tiles that use a changed entry. */
+void tile_atlas_set_palette (Tile_Atlas *atlas, uint32_t palette, const uint8_t *colours);
+
+/* Forget every cached tile, for when the tile store has been replaced. */
+void tile_atlas_invalidate (Tile_Atlas *atlas);
+
+/* Draw a tile from the store as a size × size square, with flip holding TILE_HFLIP and TILE_VFLIP.
+ * The tile is drawn into the atlas on first use. Every tile comes from the same texture, so
+ * consecutive calls merge into a single draw command. */
+void tile_atlas_draw (ImDrawList *draw_list, Tile_Atlas *atlas, const Tile_Store *store,
+                      uint32_t tile, uint32_t palette, uint32_t flip, float x, float y, float size);
+
+/* Upload the tiles drawn this frame. Call once per frame, after the last tile_atlas_draw (). */
+void tile_atlas_flush (Tile_Atlas *atlas);
@@ -0,0 +1,410 @@
+/*
+ * Tile count reduction.
+ *
+ * Merges near-identical tiles until a tile budget is met. The distance
+ * between two tiles is the Hamming distance between their planar forms,
+ * taken over the four flipped variants of the second tile. Each tile keeps
+ * a short list of its nearest neighbours, and the cheapest merge (distance weighted by the
+ * number of times the tile is used in the map) is made first, using a
+ * lazily-updated priority queue. Map entries
+ * that pointed at a merged tile are redirected to the surviving tile, with
+ * the flip bits adjusted to match.
+ *
+ * Tiles in 8×16 sprite pairs are kept as they are, as sprites cannot be
+ * flipped and each pair must stay together at an even index. Map tiles may
+ * still be merged into them.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "jobs.h"
+#include "tile_store.h"
+#include "trace.h"
+#include "tile_reduce.h"
+
+#define REDUCE_BATCH_SIZE 64
+#define REDUCE_NEIGHBOURS 8
+
+/* Merge cost and tile, ordered by cost then by tile index */
+typedef std::pair<uint64_t, uint32_t> Merge;
+
+typedef struct Reduce_Work_s {
+    Job *job;
+    uint32_t count;
+    std::vector<uint64_t> planar;       /* Four flipped variants per tile, four words each */
+    std::vector<uint64_t> usage;        /* Uses in the map of each cluster */
+    std::vector<bool> active;           /* Tile still represents a cluster */
+    /* The REDUCE_NEIGHBOURS nearest tiles to each tile, closest first */
+    std::vector<uint32_t> neighbour;
+    std::vector<uint8_t> neighbour_flip;    /* Flip to apply to the neighbour to match this tile */
+    std::vector<uint32_t> neighbour_distance;
+    std::vector<uint8_t> nearest;           /* First neighbour that is still active */
+} Reduce_Work;
+
+
+/*
+ * Reverse the bits of a byte.
+ */
+static uint8_t reverse_bits (uint8_t value)
+{
+    value = ((value & 0xf0) >> 4) | ((value & 0x0f) << 4);
+    value = ((value & 0xcc) >> 2) | ((value & 0x33) << 2);
+    value = ((value & 0xaa) >> 1) | ((value & 0x55) << 1);
+    return value;
+}
+
+
+/*
+ * Build the four flipped variants of a tile's planar data.
+ * Variant bit 0 is a horizontal flip, bit 1 is a vertical flip.
+ */
+static void planar_variants (const uint8_t *planar, uint64_t *variants)
+{
+    uint8_t flipped [4][32];
+
+    for (uint32_t row = 0; row < 8; row++)
+    {
+        for (uint32_t plane = 0; plane < 4; plane++)
+        {
+            uint8_t value = planar [row * 4 + plane];
+            flipped [0][row * 4 + plane] = value;
+            flipped [1][row * 4 + plane] = reverse_bits (value);
+            flipped [2][(7 - row) * 4 + plane] = value;
+            flipped [3][(7 - row) * 4 + plane] = reverse_bits (value);
+        }
+    }
+
+    memcpy (variants, flipped, sizeof (flipped));
+}
+
+
+/*
+ * Hamming distance between tile a and the given variant of tile b.
+ *
+ * Without a hardware popcount instruction, __builtin_popcountll becomes a
+ * library call per word, so the bits are counted in parallel instead.
+ */
+static inline uint32_t planar_distance (const uint64_t *a, const uint64_t *b)
+{
+#if defined (__POPCNT__) || defined (__aarch64__)
+    return __builtin_popcountll (a [0] ^ b [0]) + __builtin_popcountll (a [1] ^ b [1]) +
+           __builtin_popcountll (a [2] ^ b [2]) + __builtin_popcountll (a [3] ^ b [3]);
+#else
+    uint64_t bytes = 0;
+
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        uint64_t x = a [i] ^ b [i];
+        x = x - ((x >> 1) & 0x5555555555555555);
+        x = (x & 0x3333333333333333) + ((x >> 2) & 0x3333333333333333);
+        bytes += (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0f;
+    }
+
+    /* Each byte holds at most 32, so the sum of the bytes fits in the top byte */
+    return (bytes * 0x0101010101010101) >> 56;
+#endif
+}
+
+
+/*
+ * Find the nearest active tiles to tile a, over all flips. Ties go to the lowest index.
+ */
+static void find_neighbours (Reduce_Work *work, uint32_t a)
+{
+    const uint64_t *planar_a = &work->planar [a * 16];
+    uint32_t *neighbour = &work->neighbour [a * REDUCE_NEIGHBOURS];
+    uint8_t *neighbour_flip = &work->neighbour_flip [a * REDUCE_NEIGHBOURS];
+    uint32_t *neighbour_distance = &work->neighbour_distance [a * REDUCE_NEIGHBOURS];
+
+    for (uint32_t i = 0; i < REDUCE_NEIGHBOURS; i++)
+    {
+        neighbour [i] = a;
+        neighbour_flip [i] = 0;
+        neighbour_distance [i] = UINT32_MAX;
+    }
+
+    for (uint32_t b = 0; b < work->count; b++)
+    {
+        uint32_t distance = UINT32_MAX;
+        uint8_t flip = 0;
+
+        if (b == a || !work->active [b])
+        {
+            continue;
+        }
+
+        for (uint32_t f = 0; f < 4; f++)
+        {
+            uint32_t d = planar_distance (planar_a, &work->planar [b * 16 + f * 4]);
+            if (d < distance)
+            {
+                distance = d;
+                flip = f;
+            }
+        }
+
+        if (distance >= neighbour_distance [REDUCE_NEIGHBOURS - 1])
+        {
+            continue;
+        }
+
+        /* Insertion into the sorted list */
+        uint32_t i = REDUCE_NEIGHBOURS - 1;
+        while (i > 0 && neighbour_distance [i - 1] > distance)
+        {
+            neighbour [i] = neighbour [i - 1];
+            neighbour_flip [i] = neighbour_flip [i - 1];
+            neighbour_distance [i] = neighbour_distance [i - 1];
+            i--;
+        }
+        neighbour [i] = b;
+        neighbour_flip [i] = flip;
+        neighbour_distance [i] = distance;
+    }
+
+    work->nearest [a] = 0;
+}
+
+
+/*
+ * Advance to the nearest tile to a that is still active.
+ *
+ * Tiles never move closer to each other, so the first active tile in the
+ * neighbour list is the nearest. The list is only rebuilt once every tile
+ * in it has been merged away.
+ */
+static void update_nearest (Reduce_Work *work, uint32_t a)
+{
+    while (work->nearest [a] < REDUCE_NEIGHBOURS &&
+           !work->active [work->neighbour [a * REDUCE_NEIGHBOURS + work->nearest [a]]])
+    {
+        work->nearest [a]++;
+    }
+
+    if (work->nearest [a] == REDUCE_NEIGHBOURS)
+    {
+        find_neighbours (work, a);
+    }
+}
+
+
+/* Nearest active tile to a, the flip to apply to it, and the distance */
+#define NEAREST(W, A)           ((W).neighbour [(A) * REDUCE_NEIGHBOURS + (W).nearest [A]])
+#define NEAREST_FLIP(W, A)      ((W).neighbour_flip [(A) * REDUCE_NEIGHBOURS + (W).nearest [A]])
+#define NEAREST_DISTANCE(W, A)  ((W).neighbour_distance [(A) * REDUCE_NEIGHBOURS + (W).nearest [A]])
+
+
+/*
+ * Find the nearest tiles for a batch of tiles.
+ */
+static void find_nearest_batch (void *data, uint32_t begin, uint32_t end)
+{
+    Reduce_Work *work = (Reduce_Work *) data;
+    TRACE_ZONE ("find_neighbours");
+
+    for (uint32_t a = begin; a < end && !job_cancelled (work->job); a++)
+    {
+        find_neighbours (work, a);
+    }
+}
+
+
+/*
+ * Read a pixel from a tile, as seen through a flip.
+ */
+static inline uint8_t flipped_pixel (const Tile *tile, uint32_t x, uint32_t y, uint8_t flip)
+{
+    x = (flip & 1) ? 7 - x : x;
+    y = (flip & 2) ? 7 - y : y;
+    return tile->pixel [x + y * 8];
+}
+
+
+/*
+ * Job function: merge similar tiles until the budget is met.
+ */
+void tile_reduce_run (Job *job)
+{
+    Reduce_Context *context = (Reduce_Context *) job->data;
+    Reduce_Work work;
+    uint32_t count = context->store.tiles.size ();
+
+    context->success = false;
+    context->tiles_before = count;
+    context->pixels_changed = 0;
+    context->pixels_total = (uint64_t) context->map.entry.size () * 64;
+    context->budget = std::max (context->budget, 1u);
+
+    if (count <= context->budget)
+    {
+        context->success = true;
+        return;
+    }
+
+    work.job = job;
+    work.count = count;
+    work.planar.resize (count * 16);
+    work.usage.assign (count, 0);
+    work.active.assign (count, true);
+    work.neighbour.resize (count * REDUCE_NEIGHBOURS);
+    work.neighbour_flip.resize (count * REDUCE_NEIGHBOURS);
+    work.neighbour_distance.resize (count * REDUCE_NEIGHBOURS);
+    work.nearest.resize (count);
+
+    for (uint32_t t = 0; t < count; t++)
+    {
+        planar_variants (context->store.tiles [t].planar, &work.planar [t * 16]);
+    }
+
+    for (uint32_t entry : context->map.entry)
+    {
+        work.usage [entry & TILE_INDEX_MASK]++;
+    }
+    std::vector<uint64_t> original_usage = work.usage;
+
+    /* Which surviving tile each original tile maps to, and through which flip */
+    std::vector<uint32_t> target (count);
+    std::vector<uint8_t> target_flip (count, 0);
+    std::vector<std::vector<uint32_t>> members (count);
+    for (uint32_t t = 0; t < count; t++)
+    {
+        target [t] = t;
+        members [t].push_back (t);
+    }
+
+    /* The top tile of each 8×16 sprite pair */
+    std::vector<bool> pair_top (count, false);
+    if (context->store.pair_index)
+    {
+        for (const std::pair<const uint64_t, uint32_t> &pair : *context->store.pair_index)
+        {
+            pair_top [pair.second] = true;
+        }
+    }
+
+    job_set_progress (job, 0, count - context->budget + count / 8);
+    jobs_parallel_for (count, REDUCE_BATCH_SIZE, find_nearest_batch, &work);
+
+    /* Queue of candidate merges, cheapest first. Queued costs are lower bounds:
+     * a tile's cost only rises as its neighbours are merged away and its use
+     * count grows, so stale entries are re-evaluated when they reach the front. */
+    std::priority_queue<Merge, std::vector<Merge>, std::greater<Merge>> queue;
+    for (uint32_t t = 0; t < count; t++)
+    {
+        if (!pair_top [t] && !(t > 0 && pair_top [t - 1]))
+        {
+            queue.push (Merge (work.usage [t] * NEAREST_DISTANCE (work, t), t));
+        }
+    }
+
+    uint32_t remaining = count;
+    while (remaining > context->budget && !queue.empty ())
+    {
+        if (job_cancelled (job))
+        {
+            context->error = "Cancelled";
+            return;
+        }
+
+        uint32_t a = queue.top ().second;
+        uint64_t queued_cost = queue.top ().first;
+        queue.pop ();
+
+        if (!work.active [a])
+        {
+            continue;
+        }
+
+        update_nearest (&work, a);
+
+        uint64_t cost = work.usage [a] * NEAREST_DISTANCE (work, a);
+        if (cost > queued_cost)
+        {
+            queue.push (Merge (cost, a));
+            continue;
+        }
+
+        /* Merge a into b: a looks like b seen through flip */
+        uint32_t b = NEAREST (work, a);
+        uint8_t flip = NEAREST_FLIP (work, a);
+
+        for (uint32_t member : members [a])
+        {
+            target [member] = b;
+            target_flip [member] ^= flip;
+            members [b].push_back (member);
+        }
+        members [a].clear ();
+
+        work.usage [b] += work.usage [a];
+        work.active [a] = false;
+        remaining--;
+
+        job->progress++;
+    }
+
+    /* Rebuild the store from the surviving tiles, keeping their order and their sprite pairs */
+    Tile_Store store;
+    std::vector<uint32_t> new_index (count);
+    for (uint32_t t = 0; t < count; t++)
+    {
+        const Tile *tile = &context->store.tiles [t];
+
+        if (pair_top [t])
+        {
+            new_index [t] = tile_store_add_pair (&store, tile, &context->store.tiles [t + 1]);
+            new_index [t + 1] = new_index [t] + 1;
+            t++;
+        }
+        else if (work.active [t])
+        {
+            new_index [t] = tile_store_add (&store, tile, tile_hash (tile->pixel));
+        }
+    }
+
+    /* Redirect the map, and measure the error introduced */
+    for (uint32_t i = 0; i < context->map.entry.size (); i++)
+    {
+        uint32_t &entry = *context->map.entry.write (i);
+        uint32_t original = entry & TILE_INDEX_MASK;
+        uint8_t flip = target_flip [original];
+        uint32_t attributes = entry & ~TILE_INDEX_MASK;
+
+        if (flip & 1)
+        {
+            attributes ^= TILE_HFLIP;
+        }
+        if (flip & 2)
+        {
+            attributes ^= TILE_VFLIP;
+        }
+
+        entry = new_index [target [original]] | attributes;
+    }
+
+    for (uint32_t t = 0; t < count; t++)
+    {
+        const Tile *original = &context->store.tiles [t];
+        const Tile *replacement = &context->store.tiles [target [t]];
+        uint32_t changed = 0;
+
+        for (uint32_t y = 0; y < 8; y++)
+        {
+            for (uint32_t x = 0; x < 8; x++)
+            {
+                changed += original->pixel [x + y * 8] != flipped_pixel (replacement, x, y, target_flip [t]);
+            }
+        }
+
+        context->pixels_changed += changed * original_usage [t];
+    }
+
+    std::swap (context->store, store);
+    context->success = true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+/*
+ * Tile count reduction API.
+ */
+
+#include <stdint.h>
+
+#include <string>
+
+#include "tile_store.h"
+
+typedef struct Job_s Job;
+
+typedef struct Reduce_Context_s {
+    /* Input, replaced with the reduced tiles on success */
+    Tile_Store store;
+    Tile_Map map;
+    uint32_t budget;
+
+    /* Results */
+    bool success;
+    std::string error;
+    uint32_t tiles_before;
+    uint64_t pixels_changed;    /* Over every use of every tile in the map */
+    uint64_t pixels_total;
+} Reduce_Context;
+
+/* Job function: merge similar tiles in the Reduce_Context in job->data until the budget is met. */
+void tile_reduce_run (Job *job);
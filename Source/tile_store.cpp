@@ -0,0 +1,298 @@
+/*
+ * Tile store.
+ *
+ * Holds a set of unique 8×8 tiles, along with a hash index used to
+ * deduplicate tiles as they are added. Tiles for 8×16 sprites are added as
+ * aligned even/odd pairs, and deduplicated as a pair.
+ *
+ * The tiles and indices are shared between copies of a store, so that
+ * documents duplicated from one another only pay for what they change.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tile_store.h"
+
+
+/*
+ * Get a tile for writing, first duplicating its block if it is shared.
+ */
+Tile *Tile_Blocks::write (size_t i)
+{
+    std::shared_ptr<Tile_Block> &block = blocks [i / TILE_BLOCK_SIZE];
+
+    if (block.use_count () > 1)
+    {
+        block = std::make_shared<Tile_Block> (*block);
+    }
+
+    return &block->tile [i % TILE_BLOCK_SIZE];
+}
+
+
+/*
+ * Append a tile.
+ */
+void Tile_Blocks::push_back (const Tile &tile)
+{
+    if (count % TILE_BLOCK_SIZE == 0)
+    {
+        blocks.push_back (std::make_shared<Tile_Block> ());
+    }
+
+    *write (count++) = tile;
+}
+
+
+/*
+ * Resize, with any new tiles blank.
+ */
+void Tile_Blocks::resize (size_t size)
+{
+    static const Tile blank = { { 0 }, { 0 } };
+
+    if (size < count)
+    {
+        blocks.resize ((size + TILE_BLOCK_SIZE - 1) / TILE_BLOCK_SIZE);
+        count = size;
+    }
+
+    while (count < size)
+    {
+        push_back (blank);
+    }
+}
+
+
+/*
+ * Remove all tiles.
+ */
+void Tile_Blocks::clear (void)
+{
+    blocks.clear ();
+    count = 0;
+}
+
+
+/*
+ * Count the blocks shared with other copies.
+ */
+size_t Tile_Blocks::shared_block_count (void) const
+{
+    size_t shared = 0;
+
+    for (const std::shared_ptr<Tile_Block> &block : blocks)
+    {
+        shared += block.use_count () > 1;
+    }
+
+    return shared;
+}
+
+
+/*
+ * Get the entries for writing, first duplicating them if they are shared.
+ */
+std::vector<uint32_t> *Tile_Map_Entries::unshare (void)
+{
+    if (!entries)
+    {
+        entries = std::make_shared<std::vector<uint32_t>> ();
+    }
+    else if (entries.use_count () > 1)
+    {
+        entries = std::make_shared<std::vector<uint32_t>> (*entries);
+    }
+
+    return entries.get ();
+}
+
+
+/*
+ * Get an entry for writing.
+ */
+uint32_t *Tile_Map_Entries::write (size_t i)
+{
+    return &(*unshare ()) [i];
+}
+
+
+/*
+ * Append an entry.
+ */
+void Tile_Map_Entries::push_back (uint32_t entry)
+{
+    unshare ()->push_back (entry);
+}
+
+
+/*
+ * Reserve space for entries.
+ */
+void Tile_Map_Entries::reserve (size_t size)
+{
+    unshare ()->reserve (size);
+}
+
+
+/*
+ * Resize, with any new entries zero.
+ */
+void Tile_Map_Entries::resize (size_t size)
+{
+    unshare ()->resize (size, 0);
+}
+
+
+/*
+ * Remove all entries, leaving any copies untouched.
+ */
+void Tile_Map_Entries::clear (void)
+{
+    entries.reset ();
+}
+
+
+/*
+ * Get an index for writing, first duplicating it if it is shared.
+ */
+static Tile_Index *tile_index_write (std::shared_ptr<Tile_Index> &index)
+{
+    if (!index)
+    {
+        index = std::make_shared<Tile_Index> ();
+    }
+    else if (index.use_count () > 1)
+    {
+        index = std::make_shared<Tile_Index> (*index);
+    }
+
+    return index.get ();
+}
+
+
+/*
+ * Hash the pixels of a tile (FNV-1a, eight bytes at a time).
+ */
+uint64_t tile_hash (const uint8_t *pixel)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (uint32_t i = 0; i < 64; i += 8)
+    {
+        uint64_t chunk;
+        memcpy (&chunk, &pixel [i], sizeof (chunk));
+        hash = (hash ^ chunk) * 0x100000001b3;
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+
+/*
+ * Encode 64 pixels into the 32-byte planar format used by the VDP.
+ */
+void tile_encode_planar (const uint8_t *pixel, uint8_t *planar)
+{
+    for (uint32_t row = 0; row < 8; row++)
+    {
+        uint8_t plane [4] = { 0 };
+
+        for (uint32_t col = 0; col < 8; col++)
+        {
+            uint8_t value = pixel [col + (row * 8)];
+
+            for (uint32_t bit = 0; bit < 4; bit++)
+            {
+                if (value & (1 << bit))
+                {
+                    plane [bit] |= 0x80 >> col;
+                }
+            }
+        }
+
+        memcpy (&planar [row * 4], plane, sizeof (plane));
+    }
+}
+
+
+/*
+ * Add a tile to the store, returning the index of an identical tile if one exists.
+ */
+uint32_t tile_store_add (Tile_Store *store, const Tile *tile, uint64_t hash)
+{
+    if (store->index)
+    {
+        auto range = store->index->equal_range (hash);
+
+        for (auto it = range.first; it != range.second; it++)
+        {
+            if (memcmp (store->tiles [it->second].pixel, tile->pixel, sizeof (tile->pixel)) == 0)
+            {
+                return it->second;
+            }
+        }
+    }
+
+    uint32_t index = store->tiles.size ();
+    store->tiles.push_back (*tile);
+    tile_index_write (store->index)->insert (std::make_pair (hash, index));
+
+    return index;
+}
+
+
+/*
+ * Add a pair of tiles for an 8×16 sprite, starting at an even index.
+ */
+uint32_t tile_store_add_pair (Tile_Store *store, const Tile *top, const Tile *bottom)
+{
+    uint64_t top_hash = tile_hash (top->pixel);
+    uint64_t bottom_hash = tile_hash (bottom->pixel);
+    uint64_t hash = top_hash ^ (bottom_hash * 0x9e3779b97f4a7c15);
+    if (store->pair_index)
+    {
+        auto range = store->pair_index->equal_range (hash);
+
+        for (auto it = range.first; it != range.second; it++)
+        {
+            if (memcmp (store->tiles [it->second].pixel, top->pixel, sizeof (top->pixel)) == 0 &&
+                memcmp (store->tiles [it->second + 1].pixel, bottom->pixel, sizeof (bottom->pixel)) == 0)
+            {
+                return it->second;
+            }
+        }
+    }
+
+    /* The VDP ignores bit 0 of the pattern index for 8×16 sprites, so pad to an even index */
+    if (store->tiles.size () & 1)
+    {
+        Tile blank;
+        memset (&blank, 0, sizeof (blank));
+        store->tiles.push_back (blank);
+    }
+
+    /* Both halves are also available as ordinary tiles */
+    uint32_t index = store->tiles.size ();
+    store->tiles.push_back (*top);
+    store->tiles.push_back (*bottom);
+    Tile_Index *tile_index = tile_index_write (store->index);
+    tile_index->insert (std::make_pair (top_hash, index));
+    tile_index->insert (std::make_pair (bottom_hash, index + 1));
+    tile_index_write (store->pair_index)->insert (std::make_pair (hash, index));
+
+    return index;
+}
+
+
+/*
+ * Remove all tiles.
+ */
+void tile_store_clear (Tile_Store *store)
+{
+    store->tiles.clear ();
+    store->index.reset ();
+    store->pair_index.reset ();
+}
@@ -0,0 +1,126 @@
+#pragma once
+/*
+ * Tile store API.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/* Tile map entries hold a tile index in the low 16 bits,
+ * and the upper byte of the VDP name table entry in bits 16-23. */
+#define TILE_INDEX_MASK 0x0000ffff
+#define TILE_HFLIP      0x00020000
+#define TILE_VFLIP      0x00040000
+#define TILE_PRIORITY   0x00100000  /* Non-zero pixels are drawn in front of sprites */
+
+/* Convert a tile map entry into a VDP name table entry */
+#define TILE_NAME_TABLE_ENTRY(E) (((E) & 0x01ff) | (((E) >> 8) & 0xfe00))
+
+#define TILE_BLOCK_SIZE 256     /* Tiles per copy-on-write block */
+
+typedef struct Tile_s {
+    uint8_t pixel [64];     /* Palette indices, row-major */
+    uint8_t planar [32];    /* VDP pattern format, four bitplanes per row */
+} Tile;
+
+typedef struct Tile_Block_s {
+    Tile tile [TILE_BLOCK_SIZE];
+} Tile_Block;
+
+/*
+ * An array of tiles held in fixed-size blocks. Copies share their blocks, and
+ * a block is only duplicated when one of its tiles is written through a copy
+ * that shares it, so copies of a store cost memory in proportion to their
+ * differences. Reading never copies; writing goes through write ().
+ */
+class Tile_Blocks
+{
+public:
+    Tile_Blocks () : count (0) { }
+
+    size_t size (void) const { return count; }
+    bool empty (void) const { return count == 0; }
+
+    const Tile &operator[] (size_t i) const
+    {
+        return blocks [i / TILE_BLOCK_SIZE]->tile [i % TILE_BLOCK_SIZE];
+    }
+
+    /* Get a tile for writing, first duplicating its block if it is shared. */
+    Tile *write (size_t i);
+
+    void push_back (const Tile &tile);
+    void resize (size_t size);
+    void clear (void);
+
+    /* Blocks in use, and how many of them are shared with other copies. */
+    size_t block_count (void) const { return blocks.size (); }
+    size_t shared_block_count (void) const;
+
+private:
+    std::vector<std::shared_ptr<Tile_Block>> blocks;
+    size_t count;
+};
+
+typedef std::unordered_multimap<uint64_t, uint32_t> Tile_Index;
+
+/* Copies of a store share their tiles and indices until either is changed. */
+typedef struct Tile_Store_s {
+    Tile_Blocks tiles;
+    std::shared_ptr<Tile_Index> index;      /* Hash -> tile, for deduplication */
+    std::shared_ptr<Tile_Index> pair_index; /* Hash -> even tile, for 8×16 sprite pairs */
+} Tile_Store;
+
+/*
+ * The entries of a tile map. Copies share one array until either is written,
+ * as the editor only ever replaces a map whole.
+ */
+class Tile_Map_Entries
+{
+public:
+    size_t size (void) const { return entries ? entries->size () : 0; }
+    bool empty (void) const { return size () == 0; }
+
+    const uint32_t &operator[] (size_t i) const { return (*entries) [i]; }
+    const uint32_t *begin (void) const { return entries ? entries->data () : NULL; }
+    const uint32_t *end (void) const { return begin () + size (); }
+
+    /* Get an entry for writing, first duplicating the array if it is shared. */
+    uint32_t *write (size_t i);
+
+    void push_back (uint32_t entry);
+    void reserve (size_t size);
+    void resize (size_t size);
+    void clear (void);
+
+private:
+    std::vector<uint32_t> *unshare (void);
+
+    std::shared_ptr<std::vector<uint32_t>> entries;
+};
+
+typedef struct Tile_Map_s {
+    uint32_t width;             /* In tiles */
+    uint32_t height;
+    Tile_Map_Entries entry;
+} Tile_Map;
+
+/* Hash the pixels of a tile. */
+uint64_t tile_hash (const uint8_t *pixel);
+
+/* Encode 64 pixels into the 32-byte planar format used by the VDP. */
+void tile_encode_planar (const uint8_t *pixel, uint8_t *planar);
+
+/* Add a tile to the store, returning the index of an identical tile if one exists. */
+uint32_t tile_store_add (Tile_Store *store, const Tile *tile, uint64_t hash);
+
+/* Add a pair of tiles for an 8×16 sprite, starting at an even index. Returns
+ * the index of the top tile, reusing an identical pair if one exists. */
+uint32_t tile_store_add_pair (Tile_Store *store, const Tile *top, const Tile *bottom);
+
+/* Remove all tiles. */
+void tile_store_clear (Tile_Store *store);
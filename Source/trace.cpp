@@ -0,0 +1,318 @@
+/*
+ * Scoped tracing.
+ *
+ * Each thread appends to its own fixed-size ring buffer, so recording takes
+ * no locks; once a buffer is full the oldest events are overwritten. The
+ * buffers are registered on first use and kept until exit, so a trace can
+ * still name threads that have finished.
+ *
+ * Only the owning thread moves a buffer's head. Starting a trace marks where
+ * each buffer's events begin rather than rewinding it, and each thread flags
+ * the event it is writing, so that trace_write () can wait for any event
+ * that was begun before recording stopped.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+#define TRACE_BUFFER_SIZE 65536
+
+typedef enum Trace_Type_e {
+    TRACE_ZONE_COMPLETE = 0,
+    TRACE_FLOW_BEGIN,
+    TRACE_FLOW_STEP,
+    TRACE_FLOW_END
+} Trace_Type;
+
+typedef struct Trace_Event_s {
+    const char *name;
+    uint64_t time;      /* Start of a zone, or the time of a flow event */
+    uint64_t value;     /* Duration of a zone, or the id of a flow event */
+    uint32_t type;
+} Trace_Event;
+
+typedef struct Trace_Buffer_s {
+    Trace_Event events [TRACE_BUFFER_SIZE];
+    std::atomic<uint64_t> head;     /* Total events written */
+    std::atomic<uint64_t> first;    /* Head when recording last started */
+    std::atomic<bool> writing;      /* The owning thread is writing an event */
+    std::string thread_name;
+    uint32_t thread_id;
+} Trace_Buffer;
+
+std::atomic<bool> trace_enabled (false);
+
+static std::mutex trace_buffers_mutex;
+static std::vector<Trace_Buffer *> trace_buffers;
+static thread_local Trace_Buffer *trace_buffer = NULL;
+static std::atomic<uint64_t> trace_flow_next (1);
+static const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now ();
+
+
+/*
+ * Monotonic time in nanoseconds.
+ * Never returns zero, which Trace_Zone uses to mean "not recording".
+ */
+uint64_t trace_now (void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - trace_epoch).count () + 1;
+}
+
+
+/*
+ * Get the calling thread's buffer, registering it on first use.
+ */
+static Trace_Buffer *trace_thread_buffer (void)
+{
+    if (trace_buffer == NULL)
+    {
+        std::lock_guard<std::mutex> lock (trace_buffers_mutex);
+
+        trace_buffer = new Trace_Buffer;
+        trace_buffer->head = 0;
+        trace_buffer->first = 0;
+        trace_buffer->writing = false;
+        trace_buffer->thread_id = trace_buffers.size () + 1;
+        trace_buffers.push_back (trace_buffer);
+    }
+
+    return trace_buffer;
+}
+
+
+/*
+ * Append an event to the calling thread's buffer.
+ */
+static void trace_push (uint32_t type, const char *name, uint64_t time, uint64_t value)
+{
+    Trace_Buffer *buffer = trace_thread_buffer ();
+
+    /* Flag the write before checking that recording has not stopped, so that
+     * trace_write () either sees the flag or this thread sees the stop */
+    buffer->writing.store (true, std::memory_order_seq_cst);
+    if (!trace_enabled.load (std::memory_order_seq_cst))
+    {
+        buffer->writing.store (false, std::memory_order_release);
+        return;
+    }
+
+    uint64_t head = buffer->head.load (std::memory_order_relaxed);
+    Trace_Event *event = &buffer->events [head % TRACE_BUFFER_SIZE];
+
+    event->name = name;
+    event->time = time;
+    event->value = value;
+    event->type = type;
+
+    buffer->head.store (head + 1, std::memory_order_release);
+    buffer->writing.store (false, std::memory_order_release);
+}
+
+
+/*
+ * Record a zone that started at start_ns and ends now.
+ */
+void trace_zone_end (const char *name, uint64_t start_ns)
+{
+    trace_push (TRACE_ZONE_COMPLETE, name, start_ns, trace_now () - start_ns);
+}
+
+
+/*
+ * Name the calling thread in the trace.
+ */
+void trace_thread_name (const char *name)
+{
+    Trace_Buffer *buffer = trace_thread_buffer ();
+
+    std::lock_guard<std::mutex> lock (trace_buffers_mutex);
+    buffer->thread_name = name;
+}
+
+
+/*
+ * Clear the buffers and start recording.
+ */
+void trace_start (void)
+{
+    {
+        std::lock_guard<std::mutex> lock (trace_buffers_mutex);
+
+        for (Trace_Buffer *buffer : trace_buffers)
+        {
+            buffer->first = buffer->head.load (std::memory_order_acquire);
+        }
+    }
+
+    trace_enabled = true;
+}
+
+
+/*
+ * Stop recording.
+ */
+void trace_stop (void)
+{
+    trace_enabled.store (false, std::memory_order_seq_cst);
+}
+
+
+/*
+ * True while recording.
+ */
+bool trace_recording (void)
+{
+    return trace_enabled.load (std::memory_order_relaxed);
+}
+
+
+/*
+ * Start a flow, returning its id.
+ */
+uint64_t trace_flow_begin (const char *name)
+{
+    if (!trace_enabled.load (std::memory_order_relaxed))
+    {
+        return 0;
+    }
+
+    uint64_t id = trace_flow_next++;
+    trace_push (TRACE_FLOW_BEGIN, name, trace_now (), id);
+
+    return id;
+}
+
+
+/*
+ * Continue a flow on the calling thread.
+ */
+void trace_flow_step (const char *name, uint64_t id)
+{
+    if (id != 0 && trace_enabled.load (std::memory_order_relaxed))
+    {
+        trace_push (TRACE_FLOW_STEP, name, trace_now (), id);
+    }
+}
+
+
+/*
+ * Finish a flow on the calling thread.
+ */
+void trace_flow_end (const char *name, uint64_t id)
+{
+    if (id != 0 && trace_enabled.load (std::memory_order_relaxed))
+    {
+        trace_push (TRACE_FLOW_END, name, trace_now (), id);
+    }
+}
+
+
+/*
+ * Write a name as a JSON string.
+ */
+static void trace_write_string (FILE *file, const char *string)
+{
+    fputc ('"', file);
+
+    for (const char *c = string; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc ('\\', file);
+        }
+
+        if ((uint8_t) *c >= 0x20)
+        {
+            fputc (*c, file);
+        }
+    }
+
+    fputc ('"', file);
+}
+
+
+/*
+ * Write the recorded events as Chrome trace-event JSON.
+ * Times are in microseconds, as the format expects.
+ */
+int trace_write (const char *path)
+{
+    static const char *phase [] = { "X", "s", "t", "f" };
+    FILE *file = fopen (path, "w");
+    bool first = true;
+
+    if (file == NULL)
+    {
+        fprintf (stderr, "Unable to open %s for writing.\n", path);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock (trace_buffers_mutex);
+
+    /* Recording must have stopped, and any event begun before then be finished */
+    trace_stop ();
+    for (Trace_Buffer *buffer : trace_buffers)
+    {
+        while (buffer->writing.load (std::memory_order_seq_cst))
+        {
+            std::this_thread::yield ();
+        }
+    }
+
+    fprintf (file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (Trace_Buffer *buffer : trace_buffers)
+    {
+        uint64_t head = buffer->head.load (std::memory_order_acquire);
+        uint64_t oldest = buffer->first.load (std::memory_order_relaxed);
+        uint64_t start = (head > oldest + TRACE_BUFFER_SIZE) ? head - TRACE_BUFFER_SIZE : oldest;
+
+        if (!buffer->thread_name.empty ())
+        {
+            fprintf (file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                     first ? "" : ",\n", buffer->thread_id);
+            trace_write_string (file, buffer->thread_name.c_str ());
+            fprintf (file, "}}");
+            first = false;
+        }
+
+        for (uint64_t i = start; i < head; i++)
+        {
+            const Trace_Event *event = &buffer->events [i % TRACE_BUFFER_SIZE];
+
+            fprintf (file, "%s{\"ph\":\"%s\",\"name\":", first ? "" : ",\n", phase [event->type]);
+            trace_write_string (file, event->name);
+            fprintf (file, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f", buffer->thread_id, event->time / 1000.0);
+
+            if (event->type == TRACE_ZONE_COMPLETE)
+            {
+                fprintf (file, ",\"dur\":%.3f}", event->value / 1000.0);
+            }
+            else
+            {
+                /* Flow ends bind to the enclosing zone rather than the next one to start */
+                fprintf (file, ",\"cat\":\"flow\",\"id\":%llu%s}", (unsigned long long) event->value,
+                         event->type == TRACE_FLOW_END ? ",\"bp\":\"e\"" : "");
+            }
+            first = false;
+        }
+    }
+
+    fprintf (file, "\n]}\n");
+
+    if (fclose (file) != 0)
+    {
+        fprintf (stderr, "Unable to write %s.\n", path);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+/*
+ * Scoped tracing API.
+ *
+ * TRACE_ZONE ("name") records the time from that line to the end of the
+ * enclosing scope. Events go to a per-thread ring buffer, and can be written
+ * out as Chrome trace-event JSON for viewing in Perfetto or chrome://tracing.
+ * While tracing is stopped a zone costs one relaxed load and a branch.
+ * Zone names must be string literals, or otherwise outlive the trace.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+
+extern std::atomic<bool> trace_enabled;
+
+/* Monotonic time in nanoseconds. */
+uint64_t trace_now (void);
+
+/* Record a zone that started at start_ns and ends now. */
+void trace_zone_end (const char *name, uint64_t start_ns);
+
+class Trace_Zone
+{
+public:
+    Trace_Zone (const char *name) : name (name), start (0)
+    {
+        if (trace_enabled.load (std::memory_order_relaxed))
+        {
+            start = trace_now ();
+        }
+    }
+
+    ~Trace_Zone ()
+    {
+        /* Zones still open when tracing stops are dropped */
+        if (start != 0 && trace_enabled.load (std::memory_order_relaxed))
+        {
+            trace_zone_end (name, start);
+        }
+    }
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_(A, B) A ## B
+#define TRACE_CONCAT(A, B) TRACE_CONCAT_(A, B)
+#define TRACE_ZONE(NAME) Trace_Zone TRACE_CONCAT (trace_zone_, __LINE__) (NAME)
+
+/* Name the calling thread in the trace. */
+void trace_thread_name (const char *name);
+
+/* Clear the buffers and start recording. */
+void trace_start (void);
+
+/* Stop recording, keeping the buffers for trace_write (). Events being recorded
+ * by other threads at the time are finished before trace_write () reads them. */
+void trace_stop (void);
+
+/* True while recording. */
+bool trace_recording (void);
+
+/* Flow arrows link work across threads, such as a job's submission to its run.
+ * trace_flow_begin returns an id (zero while stopped) to pass to the later calls,
+ * each of which binds to the zone enclosing it on the calling thread. */
+uint64_t trace_flow_begin (const char *name);
+void trace_flow_step (const char *name, uint64_t id);
+void trace_flow_end (const char *name, uint64_t id);
+
+/* Write the recorded events as Chrome trace-event JSON. */
+int trace_write (const char *path);
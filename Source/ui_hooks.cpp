@@ -0,0 +1,61 @@
+/*
+ * UI item counting.
+ *
+ * Dear ImGui calls these hooks for each item when built with
+ * IMGUI_ENABLE_TEST_ENGINE, which the SNEPSPRITE_UI_BENCHMARK option sets.
+ * Only the item count is used, for --benchmark-ui and the performance HUD.
+ */
+
+#include <stdint.h>
+
+#include "imgui.h"
+#include "imgui_internal.h"
+#include "ui_hooks.h"
+
+uint32_t ui_item_count = 0;
+
+#ifdef IMGUI_ENABLE_TEST_ENGINE
+
+/*
+ * Start counting a new frame.
+ */
+void ImGuiTestEngineHook_PreNewFrame (ImGuiContext * /* ctx */)
+{
+    ui_item_count = 0;
+}
+
+
+/*
+ * Unused.
+ */
+void ImGuiTestEngineHook_PostNewFrame (ImGuiContext * /* ctx */)
+{
+}
+
+
+/*
+ * Count an item.
+ */
+void ImGuiTestEngineHook_ItemAdd (ImGuiContext * /* ctx */, const ImRect & /* bb */, ImGuiID /* id */)
+{
+    ui_item_count++;
+}
+
+
+/*
+ * Unused.
+ */
+void ImGuiTestEngineHook_ItemInfo (ImGuiContext * /* ctx */, ImGuiID /* id */, const char * /* label */,
+                                   ImGuiItemStatusFlags /* flags */)
+{
+}
+
+
+/*
+ * Unused.
+ */
+void ImGuiTestEngineHook_Log (ImGuiContext * /* ctx */, const char * /* fmt */, ...)
+{
+}
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+/*
+ * UI item counting API.
+ */
+
+#include <stdint.h>
+
+/* Items submitted to ImGui this frame. Stays at zero unless built with the test engine hooks. */
+extern uint32_t ui_item_count;
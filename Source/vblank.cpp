@@ -0,0 +1,185 @@
+/*
+ * VBlank transfer budget.
+ *
+ * Estimates the Z80 cycles needed to write data to VRAM, and compares it
+ * with the time available while the display is blanked. Each line is 228
+ * CPU cycles. NTSC has 262 lines and PAL has 313, of which 192 are active.
+ *
+ * During VBlank the VDP accepts a write as fast as the CPU can issue one.
+ * During active display writes must be at least 26 cycles apart.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "tile_store.h"
+#include "metasprite.h"
+#include "animation.h"
+#include "vblank.h"
+
+#define CYCLES_PER_LINE     228
+#define ACTIVE_LINES        192
+
+/* ld hl, source; ld b, count; ld c, $be; then the address: ld a, l; out ($bf), a; ld a, h; or $40; out ($bf), a */
+#define RUN_SETUP_CYCLES    61
+
+/* Unrolled OUTI blocks are one pattern long, with dec a; jp nz between blocks */
+#define OUTI_BLOCK_SIZE     32
+#define OUTI_BLOCK_CYCLES   14
+
+/* OUTI; jp nz: the fastest loop that is safe during active display */
+#define ACTIVE_BYTE_CYCLES  26
+
+const char *vblank_region_names [VBLANK_REGION_COUNT] = { "NTSC (60 Hz)", "PAL (50 Hz)" };
+const char *vblank_method_names [VBLANK_METHOD_COUNT] = { "OTIR", "Unrolled OUTI" };
+
+
+/*
+ * CPU cycles available for transfers in one VBlank.
+ */
+uint32_t vblank_budget (const Vblank_Settings *settings)
+{
+    uint32_t lines = (settings->region == VBLANK_PAL) ? 313 : 262;
+    uint32_t cycles = (lines - ACTIVE_LINES) * CYCLES_PER_LINE;
+
+    return (cycles > settings->reserved_cycles) ? cycles - settings->reserved_cycles : 0;
+}
+
+
+/*
+ * CPU cycles to write bytes to VRAM in runs separate runs.
+ */
+uint32_t vblank_transfer_cycles (Vblank_Method method, uint32_t bytes, uint32_t runs)
+{
+    uint32_t cycles = runs * RUN_SETUP_CYCLES;
+
+    if (bytes == 0)
+    {
+        return 0;
+    }
+
+    if (method == VBLANK_OUTI)
+    {
+        cycles += bytes * 16 + ((bytes + OUTI_BLOCK_SIZE - 1) / OUTI_BLOCK_SIZE) * OUTI_BLOCK_CYCLES;
+    }
+    else
+    {
+        /* The last byte of each OTIR does not repeat, saving 5 cycles */
+        cycles += bytes * 21 - runs * 5;
+    }
+
+    return cycles;
+}
+
+
+/*
+ * CPU cycles to write bytes during active display.
+ */
+uint32_t vblank_active_cycles (uint32_t bytes, uint32_t runs)
+{
+    return runs * RUN_SETUP_CYCLES + bytes * ACTIVE_BYTE_CYCLES;
+}
+
+
+/*
+ * Estimate a transfer, with the number of VBlanks it needs.
+ */
+void vblank_analyse (const Vblank_Settings *settings, uint32_t bytes, uint32_t runs, Vblank_Report *report)
+{
+    uint32_t budget = vblank_budget (settings);
+
+    report->bytes = bytes;
+    report->runs = runs;
+    report->cycles = vblank_transfer_cycles (settings->method, bytes, runs);
+    report->fits = report->cycles <= budget;
+    report->vblanks = budget ? std::max (1u, (report->cycles + budget - 1) / budget) : UINT32_MAX;
+    report->suggestion.clear ();
+}
+
+
+/*
+ * Estimate the upload into each frame of an animation.
+ */
+void vblank_analyse_animation (const Vblank_Settings *settings, const Animation *animation,
+                               std::vector<Vblank_Report> *reports)
+{
+    uint32_t count = animation->frames.size ();
+
+    reports->assign (count, Vblank_Report ());
+
+    for (uint32_t f = 0; f < count; f++)
+    {
+        const Animation_Delta *delta = &animation->deltas [f];
+        Vblank_Report *report = &(*reports) [f];
+
+        /* Uploads to neighbouring slots from neighbouring patterns share one address write */
+        std::vector<Animation_Upload> uploads = delta->uploads;
+        std::sort (uploads.begin (), uploads.end (), [] (const Animation_Upload &a, const Animation_Upload &b) {
+            return a.slot < b.slot;
+        });
+
+        uint32_t runs = 0;
+        for (uint32_t i = 0; i < uploads.size (); i++)
+        {
+            if (i == 0 || uploads [i].slot != uploads [i - 1].slot + 1 ||
+                          uploads [i].pattern != uploads [i - 1].pattern + 1)
+            {
+                runs++;
+            }
+        }
+
+        uint32_t bytes = uploads.size () * 32;
+
+        /* Y table with its terminator, then the X and pattern pairs */
+        if (settings->include_sat)
+        {
+            bytes += animation->frames [f].sprite.entries.size () * 3 + 1;
+            runs += 2;
+        }
+
+        vblank_analyse (settings, bytes, runs, report);
+
+        if (report->fits)
+        {
+            continue;
+        }
+
+        /* Suggest the cheapest way to make the frame fit */
+        const Animation_Frame *previous = &animation->frames [(f + count - 1) % count];
+        uint32_t budget = vblank_budget (settings);
+        char suggestion [256];
+
+        /* The bytes left over once the VBlank is used up, written as one run after it */
+        uint32_t overflow = bytes - std::min (bytes, (uint32_t) ((uint64_t) bytes * budget / report->cycles));
+        uint32_t active = vblank_active_cycles (overflow, 1);
+
+        if (settings->method == VBLANK_OTIR &&
+            vblank_transfer_cycles (VBLANK_OUTI, bytes, runs) <= budget)
+        {
+            snprintf (suggestion, sizeof (suggestion), "Fits using unrolled OUTI.");
+        }
+        else if (previous->duration >= 2 && active <= ACTIVE_LINES * CYCLES_PER_LINE)
+        {
+            snprintf (suggestion, sizeof (suggestion),
+                      "The last %u bytes can be written during active display while frame %u is shown, "
+                      "taking %u%% of it (needs a second buffer).",
+                      overflow, (f + count - 1) % count, active * 100 / (ACTIVE_LINES * CYCLES_PER_LINE));
+        }
+        else if (previous->duration >= report->vblanks)
+        {
+            snprintf (suggestion, sizeof (suggestion),
+                      "Split the upload over %u VBlanks while frame %u is shown (needs a second buffer).",
+                      report->vblanks, (f + count - 1) % count);
+        }
+        else
+        {
+            snprintf (suggestion, sizeof (suggestion),
+                      "Needs %u VBlanks: show frame %u for at least %u video frames and split the upload, "
+                      "or share more tiles with it.", report->vblanks, (f + count - 1) % count, report->vblanks);
+        }
+
+        report->suggestion = suggestion;
+    }
+}
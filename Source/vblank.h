@@ -0,0 +1,58 @@
+#pragma once
+/*
+ * VBlank transfer budget API.
+ */
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+typedef struct Animation_s Animation;
+
+typedef enum Vblank_Region_e {
+    VBLANK_NTSC = 0,
+    VBLANK_PAL,
+    VBLANK_REGION_COUNT
+} Vblank_Region;
+
+typedef enum Vblank_Method_e {
+    VBLANK_OTIR = 0,    /* 21 cycles per byte */
+    VBLANK_OUTI,        /* Unrolled, 16 cycles per byte */
+    VBLANK_METHOD_COUNT
+} Vblank_Method;
+
+extern const char *vblank_region_names [VBLANK_REGION_COUNT];
+extern const char *vblank_method_names [VBLANK_METHOD_COUNT];
+
+typedef struct Vblank_Settings_s {
+    Vblank_Region region;
+    Vblank_Method method;
+    uint32_t reserved_cycles;   /* Taken by the rest of the VBlank handler */
+    bool include_sat;           /* Count the sprite attribute table upload */
+} Vblank_Settings;
+
+typedef struct Vblank_Report_s {
+    uint32_t bytes;
+    uint32_t runs;              /* Separate VRAM address writes */
+    uint32_t cycles;
+    bool fits;
+    uint32_t vblanks;           /* VBlanks needed to complete the transfer */
+    std::string suggestion;
+} Vblank_Report;
+
+/* CPU cycles available for transfers in one VBlank. */
+uint32_t vblank_budget (const Vblank_Settings *settings);
+
+/* CPU cycles to write bytes to VRAM in runs separate runs. */
+uint32_t vblank_transfer_cycles (Vblank_Method method, uint32_t bytes, uint32_t runs);
+
+/* CPU cycles to write bytes during active display, where writes must be at least 26 cycles apart. */
+uint32_t vblank_active_cycles (uint32_t bytes, uint32_t runs);
+
+/* Estimate a transfer, with the number of VBlanks it needs. */
+void vblank_analyse (const Vblank_Settings *settings, uint32_t bytes, uint32_t runs, Vblank_Report *report);
+
+/* Estimate the upload into each frame of an animation, with suggestions for those that do not fit. */
+void vblank_analyse_animation (const Vblank_Settings *settings, const Animation *animation,
+                               std::vector<Vblank_Report> *reports);
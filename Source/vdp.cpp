@@ -0,0 +1,133 @@
+/*
+ * VDP preview renderer.
+ *
+ * Composites the tile map and sprites one scanline at a time, the way the
+ * Master System's VDP does. Only the first eight sprites on each line (in
+ * sprite table order) are drawn, and sprite colour 0 is transparent.
+ * 8×16 sprites take their lower half from the odd pattern of the pair.
+ * Background tiles with the priority bit set cover sprites, other than
+ * where the background pixel is colour 0.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "imgui.h"
+#include "tile_store.h"
+#include "colour.h"
+#include "vdp.h"
+
+
+/*
+ * Render a 256×192 frame as RGBA pixels.
+ */
+void vdp_render (const Vdp_Scene *scene, uint32_t *pixels, uint8_t *line_sprites)
+{
+    const Tile_Store *store = scene->store;
+    const Tile_Map *map = scene->map;
+    uint32_t colour [16];
+    uint32_t sprite_count = std::min ((uint32_t) scene->sprites.size (), (uint32_t) VDP_SPRITES_MAX);
+    static const uint8_t blank [64] = { 0 };
+    int32_t sprite_height = scene->tall_sprites ? 16 : 8;
+
+    /* Palette as RGBA */
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        uint8_t rgb [3];
+        sms_colour_rgb (scene->palette [i], rgb);
+        colour [i] = IM_COL32 (rgb [0], rgb [1], rgb [2], 255);
+    }
+
+    for (uint32_t line = 0; line < VDP_HEIGHT; line++)
+    {
+        uint32_t *out = &pixels [line * VDP_WIDTH];
+        uint32_t map_row = scene->map_y + line / 8;
+        bool priority [VDP_WIDTH];   /* Background pixel drawn in front of sprites */
+
+        /* Background */
+        for (uint32_t column = 0; column < VDP_WIDTH / 8; column++)
+        {
+            uint32_t map_column = scene->map_x + column;
+            const uint8_t *pixel = blank;
+            uint32_t entry = 0;
+
+            if (map_row < map->height && map_column < map->width)
+            {
+                entry = map->entry [map_column + map_row * map->width];
+                if ((entry & TILE_INDEX_MASK) < store->tiles.size ())
+                {
+                    pixel = store->tiles [entry & TILE_INDEX_MASK].pixel;
+                }
+            }
+
+            uint32_t y = (entry & TILE_VFLIP) ? 7 - (line % 8) : (line % 8);
+            const uint8_t *row = &pixel [y * 8];
+            bool high = entry & TILE_PRIORITY;
+
+            if (entry & TILE_HFLIP)
+            {
+                for (uint32_t x = 0; x < 8; x++)
+                {
+                    out [column * 8 + x] = colour [row [7 - x]];
+                    priority [column * 8 + x] = high && row [7 - x] != 0;
+                }
+            }
+            else
+            {
+                for (uint32_t x = 0; x < 8; x++)
+                {
+                    out [column * 8 + x] = colour [row [x]];
+                    priority [column * 8 + x] = high && row [x] != 0;
+                }
+            }
+        }
+
+        /* Sprites: evaluate the table in order, keeping the first eight on this line */
+        const Vdp_Sprite *visible [VDP_SPRITES_PER_LINE];
+        uint32_t visible_count = 0;
+        uint32_t total = 0;
+
+        for (uint32_t i = 0; i < sprite_count; i++)
+        {
+            const Vdp_Sprite *sprite = &scene->sprites [i];
+
+            if ((int32_t) line >= sprite->y && (int32_t) line < sprite->y + sprite_height)
+            {
+                if (visible_count < VDP_SPRITES_PER_LINE)
+                {
+                    visible [visible_count++] = sprite;
+                }
+                total++;
+            }
+        }
+
+        line_sprites [line] = total;
+
+        /* Earlier sprites have priority, so draw in reverse order */
+        for (int32_t i = visible_count - 1; i >= 0; i--)
+        {
+            const Vdp_Sprite *sprite = visible [i];
+            uint32_t sprite_line = line - sprite->y;
+            uint32_t pattern = scene->tall_sprites ? (sprite->pattern & ~1u) + sprite_line / 8 : sprite->pattern;
+
+            if (pattern >= store->tiles.size ())
+            {
+                continue;
+            }
+
+            const uint8_t *row = &store->tiles [pattern].pixel [(sprite_line % 8) * 8];
+
+            for (int32_t x = 0; x < 8; x++)
+            {
+                int32_t screen_x = sprite->x + x;
+
+                if (row [x] != 0 && screen_x >= 0 && screen_x < VDP_WIDTH && !priority [screen_x])
+                {
+                    out [screen_x] = colour [row [x]];
+                }
+            }
+        }
+    }
+}
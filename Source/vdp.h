@@ -0,0 +1,36 @@
+#pragma once
+/*
+ * VDP preview renderer API.
+ */
+
+#include <stdint.h>
+
+#include <vector>
+
+typedef struct Tile_Store_s Tile_Store;
+typedef struct Tile_Map_s Tile_Map;
+
+#define VDP_WIDTH               256
+#define VDP_HEIGHT              192
+#define VDP_SPRITES_MAX         64
+#define VDP_SPRITES_PER_LINE    8
+
+typedef struct Vdp_Sprite_s {
+    int16_t x;
+    int16_t y;          /* Top line of the sprite on screen */
+    uint16_t pattern;   /* Tile store index, bit 0 is ignored for 8×16 sprites */
+} Vdp_Sprite;
+
+typedef struct Vdp_Scene_s {
+    const Tile_Store *store;
+    const Tile_Map *map;
+    uint32_t map_x;     /* Top-left of the visible area of the map, in tiles */
+    uint32_t map_y;
+    std::vector<Vdp_Sprite> sprites;
+    bool tall_sprites;  /* 8×16 sprites, using the even/odd pattern pair */
+    const uint8_t *palette;
+} Vdp_Scene;
+
+/* Render a 256×192 frame as RGBA pixels. line_sprites receives the number of
+ * sprites on each line, including any beyond the per-line limit that were dropped. */
+void vdp_render (const Vdp_Scene *scene, uint32_t *pixels, uint8_t *line_sprites);
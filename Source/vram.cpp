@@ -0,0 +1,226 @@
+/*
+ * VRAM layout planner.
+ *
+ * Treats the 16 KiB of VRAM as 512 pattern slots. The name table and sprite
+ * attribute table are reserved first, then each item is placed into the
+ * smallest free run of slots that it fits in (best-fit), largest item first.
+ * Sprite patterns are placed first, as they are limited to one half of VRAM,
+ * and are kept on even slots in 8×16 sprite mode.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "vram.h"
+
+#define NAME_TABLE_SIZE     0x700   /* 32 × 28 entries, two bytes each */
+#define SAT_SIZE            0x100
+
+
+/*
+ * Initialise a plan with the default name table and SAT addresses.
+ */
+void vram_plan_init (Vram_Plan *plan)
+{
+    plan->name_table_address = 0x3800;
+    plan->sat_address = 0x3f00;
+    plan->sprites_high = true;
+    plan->sprites_tall = false;
+    plan->items.clear ();
+    vram_plan (plan);
+}
+
+
+/*
+ * Mark the slots covering a byte range as reserved.
+ */
+static void vram_reserve (Vram_Plan *plan, uint32_t address, uint32_t size, int16_t owner)
+{
+    uint32_t first = address / VRAM_SLOT_SIZE;
+    uint32_t last = std::min ((uint32_t) VRAM_SLOTS, (address + size + VRAM_SLOT_SIZE - 1) / VRAM_SLOT_SIZE);
+
+    for (uint32_t slot = first; slot < last; slot++)
+    {
+        plan->owner [slot] = owner;
+    }
+}
+
+
+/*
+ * Find the smallest free run of at least size slots within [first, last),
+ * starting on a multiple of align. Returns false if there is none.
+ */
+static bool vram_best_fit (const Vram_Plan *plan, uint32_t size, uint32_t align,
+                           uint32_t first, uint32_t last, uint32_t *base)
+{
+    uint32_t best_length = UINT32_MAX;
+
+    for (uint32_t slot = first; slot < last; )
+    {
+        if (plan->owner [slot] != VRAM_FREE)
+        {
+            slot++;
+            continue;
+        }
+
+        uint32_t start = slot;
+        while (slot < last && plan->owner [slot] == VRAM_FREE)
+        {
+            slot++;
+        }
+
+        start = (start + align - 1) / align * align;
+        uint32_t length = (slot > start) ? slot - start : 0;
+        if (length >= size && length < best_length)
+        {
+            best_length = length;
+            *base = start;
+        }
+    }
+
+    return best_length != UINT32_MAX;
+}
+
+
+/*
+ * Place every item using best-fit packing.
+ */
+void vram_plan (Vram_Plan *plan)
+{
+    std::vector<uint32_t> order (plan->items.size ());
+
+    for (uint32_t slot = 0; slot < VRAM_SLOTS; slot++)
+    {
+        plan->owner [slot] = VRAM_FREE;
+    }
+
+    vram_reserve (plan, plan->name_table_address, NAME_TABLE_SIZE, VRAM_NAME_TABLE);
+    vram_reserve (plan, plan->sat_address, SAT_SIZE, VRAM_SAT);
+
+    /* Constrained items first, then largest first */
+    for (uint32_t i = 0; i < order.size (); i++)
+    {
+        order [i] = i;
+    }
+    std::stable_sort (order.begin (), order.end (), [plan] (uint32_t a, uint32_t b) {
+        const Vram_Item &item_a = plan->items [a];
+        const Vram_Item &item_b = plan->items [b];
+        if (item_a.sprite != item_b.sprite)
+        {
+            return item_a.sprite;
+        }
+        return item_a.tiles > item_b.tiles;
+    });
+
+    for (uint32_t i : order)
+    {
+        Vram_Item *item = &plan->items [i];
+        uint32_t first = 0;
+        uint32_t last = VRAM_SLOTS;
+        uint32_t size = item->tiles;
+        uint32_t align = 1;
+
+        /* The sprite pattern generator covers 256 patterns */
+        if (item->sprite)
+        {
+            first = plan->sprites_high ? 256 : 0;
+            last = first + 256;
+
+            /* 8×16 sprites ignore bit 0 of the pattern index, so keep whole pairs */
+            if (plan->sprites_tall)
+            {
+                size += size & 1;
+                align = 2;
+            }
+        }
+
+        item->placed = size > 0 && vram_best_fit (plan, size, align, first, last, &item->base);
+
+        /* Sprites go at the top of their run, leaving the space below contiguous for background tiles */
+        if (item->placed && item->sprite)
+        {
+            while (item->base + size + align <= last &&
+                   plan->owner [item->base + size] == VRAM_FREE &&
+                   plan->owner [item->base + size + align - 1] == VRAM_FREE)
+            {
+                item->base += align;
+            }
+        }
+
+        if (item->placed)
+        {
+            for (uint32_t slot = item->base; slot < item->base + size; slot++)
+            {
+                plan->owner [slot] = i;
+            }
+        }
+    }
+
+    /* Free space and fragmentation */
+    plan->free_slots = 0;
+    plan->largest_free = 0;
+    plan->free_runs = 0;
+
+    for (uint32_t slot = 0; slot < VRAM_SLOTS; )
+    {
+        if (plan->owner [slot] != VRAM_FREE)
+        {
+            slot++;
+            continue;
+        }
+
+        uint32_t start = slot;
+        while (slot < VRAM_SLOTS && plan->owner [slot] == VRAM_FREE)
+        {
+            slot++;
+        }
+
+        plan->free_slots += slot - start;
+        plan->largest_free = std::max (plan->largest_free, slot - start);
+        plan->free_runs++;
+    }
+}
+
+
+/*
+ * Convert an item name into an assembler identifier.
+ */
+static std::string vram_identifier (const std::string &name)
+{
+    std::string identifier;
+
+    for (char c : name)
+    {
+        identifier += isalnum ((unsigned char) c) ? toupper ((unsigned char) c) : '_';
+    }
+
+    return identifier;
+}
+
+
+/*
+ * Export the plan to stdout as assembler constants.
+ */
+void vram_export (const Vram_Plan *plan)
+{
+    printf ("; VRAM layout\n");
+    printf (".define VRAM_NAME_TABLE $%04x\n", plan->name_table_address);
+    printf (".define VRAM_SAT $%04x\n", plan->sat_address);
+
+    for (const Vram_Item &item : plan->items)
+    {
+        std::string identifier = vram_identifier (item.name);
+
+        if (!item.placed)
+        {
+            printf ("; %s (%u tiles) does not fit\n", item.name.c_str (), item.tiles);
+            continue;
+        }
+
+        printf (".define VRAM_%s $%04x ; %u tiles\n", identifier.c_str (), item.base * VRAM_SLOT_SIZE, item.tiles);
+        printf (".define VRAM_%s_INDEX %u\n", identifier.c_str (), item.sprite ? item.base % 256 : item.base);
+    }
+}
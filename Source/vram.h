@@ -0,0 +1,50 @@
+#pragma once
+/*
+ * VRAM layout planner API.
+ */
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#define VRAM_SLOTS          512     /* 16 KiB of 32-byte patterns */
+#define VRAM_SLOT_SIZE      32
+
+/* Slot owners other than items */
+#define VRAM_FREE           -1
+#define VRAM_NAME_TABLE     -2
+#define VRAM_SAT            -3
+
+typedef struct Vram_Item_s {
+    std::string name;
+    uint32_t tiles;
+    bool sprite;        /* Must be reachable by the sprite pattern generator */
+
+    /* Set by vram_plan () */
+    bool placed;
+    uint32_t base;      /* Slot */
+} Vram_Item;
+
+typedef struct Vram_Plan_s {
+    uint16_t name_table_address;
+    uint16_t sat_address;
+    bool sprites_high;  /* Sprite patterns start at 0x2000 rather than 0x0000 */
+    bool sprites_tall;  /* 8×16 sprites: sprite patterns are placed in even/odd pairs */
+    std::vector<Vram_Item> items;
+
+    /* Set by vram_plan () */
+    int16_t owner [VRAM_SLOTS];
+    uint32_t free_slots;
+    uint32_t largest_free;
+    uint32_t free_runs;
+} Vram_Plan;
+
+/* Initialise a plan with the default name table and SAT addresses. */
+void vram_plan_init (Vram_Plan *plan);
+
+/* Place every item using best-fit packing, and measure the remaining free space. */
+void vram_plan (Vram_Plan *plan);
+
+/* Export the plan to stdout as assembler constants. */
+void vram_export (const Vram_Plan *plan);
@@ -0,0 +1,162 @@
+/*
+ * Animation streaming test.
+ *
+ * Plays animations through a simulated VRAM buffer: the initial uploads once,
+ * then each frame's uploads over several loops, checking that every sprite's
+ * slot holds its pattern when the frame is shown.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "tile_store.h"
+#include "metasprite.h"
+#include "animation.h"
+
+#define TEST_LOOPS 4
+
+
+/*
+ * Add a frame using the listed patterns.
+ */
+static void frame_add (Animation *animation, const std::vector<uint16_t> &patterns, bool tall)
+{
+    Animation_Frame frame;
+
+    frame.sprite.origin_x = 0;
+    frame.sprite.origin_y = 0;
+    frame.sprite.tall = tall;
+    frame.duration = 1;
+
+    for (uint16_t pattern : patterns)
+    {
+        Metasprite_Entry entry = { 0, 0, pattern };
+        frame.sprite.entries.push_back (entry);
+    }
+
+    animation->frames.push_back (frame);
+}
+
+
+/*
+ * Stream an animation and replay it. Returns -1 on the first mismatch.
+ */
+static int animation_check (Animation *animation, const char *name)
+{
+    animation_stream (animation);
+
+    std::vector<int32_t> vram (animation->buffer_slots, -1);
+    uint32_t bytes = 0;
+
+    for (const Animation_Upload &upload : animation->initial_uploads)
+    {
+        vram [upload.slot] = upload.pattern;
+    }
+    if (animation->initial_bytes != animation->initial_uploads.size () * 32)
+    {
+        fprintf (stderr, "%s: initial_bytes does not match the initial uploads\n", name);
+        return -1;
+    }
+
+    for (uint32_t loop = 0; loop < TEST_LOOPS; loop++)
+    {
+        for (uint32_t f = 0; f < animation->frames.size (); f++)
+        {
+            const Animation_Delta &delta = animation->deltas [f];
+            const Metasprite &sprite = animation->frames [f].sprite;
+
+            for (const Animation_Upload &upload : delta.uploads)
+            {
+                if (upload.slot >= animation->buffer_slots)
+                {
+                    fprintf (stderr, "%s: upload to slot %u is outside the buffer\n", name, upload.slot);
+                    return -1;
+                }
+                vram [upload.slot] = upload.pattern;
+            }
+            bytes += delta.bytes;
+            if (delta.bytes != delta.uploads.size () * 32)
+            {
+                fprintf (stderr, "%s: frame %u bytes do not match its uploads\n", name, f);
+                return -1;
+            }
+
+            for (uint32_t e = 0; e < sprite.entries.size (); e++)
+            {
+                uint16_t pattern = sprite.entries [e].pattern;
+                uint32_t slot = delta.entry_slot [e];
+
+                if (sprite.tall)
+                {
+                    slot += pattern & 1;
+                }
+
+                if (slot >= animation->buffer_slots || vram [slot] != pattern ||
+                    (sprite.tall && vram [slot ^ 1] != (pattern ^ 1)))
+                {
+                    fprintf (stderr, "%s: loop %u frame %u: pattern %u is not in slot %u\n",
+                             name, loop, f, pattern, slot);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+int main (int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    int result = 0;
+
+    /* The buffer ends the first loop holding different tiles from those it started with */
+    {
+        Animation animation;
+        frame_add (&animation, { 4, 1 }, false);
+        frame_add (&animation, { 1, 2 }, false);
+        frame_add (&animation, { 0, 2 }, false);
+        frame_add (&animation, { 1 }, false);
+        frame_add (&animation, { 0, 4, 2 }, false);
+
+        result |= animation_check (&animation, "loop boundary");
+    }
+
+    /* Random animations */
+    srand (1);
+    for (uint32_t i = 0; i < 20000 && result == 0; i++)
+    {
+        Animation animation;
+        bool tall = (i & 1);
+        uint32_t frames = 1 + rand () % 8;
+        uint32_t patterns = 1 + rand () % 10;
+
+        for (uint32_t f = 0; f < frames; f++)
+        {
+            std::vector<uint16_t> used;
+            uint32_t count = rand () % 5;
+
+            for (uint32_t s = 0; s < count; s++)
+            {
+                used.push_back ((rand () % patterns) * (tall ? 2 : 1) + (tall ? rand () % 2 : 0));
+            }
+            frame_add (&animation, used, tall);
+        }
+
+        char name [32];
+        snprintf (name, sizeof (name), "random %u", i);
+        result |= animation_check (&animation, name);
+    }
+
+    if (result == 0)
+    {
+        printf ("animation_stream: ok\n");
+    }
+
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+/*
+ * Dither thread-count test.
+ *
+ * Error diffusion carries state between rows, and between calls to
+ * dither_rows () through the carried error rows. Dithers one image with
+ * 1, 2, 3 and 8 worker threads, passing the rows in groups of different
+ * sizes, and checks that every mode gives the same indices each time.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "colour.h"
+#include "dither.h"
+#include "jobs.h"
+
+#define TEST_WIDTH  157
+#define TEST_HEIGHT 96
+
+static const uint32_t worker_counts [] = { 1, 2, 3, 8 };
+
+/* Rows passed to each call of dither_rows (), repeated until the image is done */
+static const std::vector<uint32_t> row_groups [] = {
+    { TEST_HEIGHT },
+    { 8 },
+    { 1 },
+    { 3 },
+    { 5, 11, 1, 8, 2 },
+};
+
+static const uint8_t test_palette [16] = {
+    0x00, 0x3f, 0x15, 0x2a, 0x03, 0x0c, 0x30, 0x0f, 0x33, 0x3c, 0x01, 0x04, 0x10, 0x17, 0x2b, 0x3e
+};
+
+typedef struct Dither_Test_s {
+    Dither_Mode mode;
+    const std::vector<uint32_t> *groups;
+    const uint8_t *rgb;
+    const uint8_t *lut;
+    std::vector<uint8_t> indexed;
+} Dither_Test;
+
+
+/*
+ * Job function: dither the whole image, a group of rows at a time.
+ */
+static void dither_test_run (Job *job)
+{
+    Dither_Test *test = (Dither_Test *) job->data;
+    Dither_State state;
+    uint32_t y = 0;
+
+    dither_init (&state, test->mode, TEST_WIDTH, test_palette, test->lut);
+    test->indexed.assign (TEST_WIDTH * TEST_HEIGHT, 0xff);
+
+    for (uint32_t group = 0; y < TEST_HEIGHT; group++)
+    {
+        uint32_t rows = std::min ((*test->groups) [group % test->groups->size ()], TEST_HEIGHT - y);
+
+        dither_rows (&state, &test->rgb [y * TEST_WIDTH * 3], y, rows, &test->indexed [y * TEST_WIDTH]);
+        y += rows;
+    }
+}
+
+
+/*
+ * Dither with the given number of workers and grouping of rows.
+ */
+static void dither_with (uint32_t workers, Dither_Test *test)
+{
+    jobs_init (workers);
+    job_submit ("dither", dither_test_run, NULL, NULL, test);
+    while (jobs_active_count () > 0)
+    {
+        jobs_poll ();
+        usleep (1000);
+    }
+    jobs_shutdown ();
+}
+
+
+int main (int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    int result = 0;
+
+    /* Gradients with a little noise, so that error is carried everywhere */
+    std::vector<uint8_t> rgb (TEST_WIDTH * TEST_HEIGHT * 3);
+    uint32_t seed = 1;
+    for (uint32_t y = 0; y < TEST_HEIGHT; y++)
+    {
+        for (uint32_t x = 0; x < TEST_WIDTH; x++)
+        {
+            uint8_t *pixel = &rgb [(x + y * TEST_WIDTH) * 3];
+
+            seed = seed * 1103515245 + 12345;
+            pixel [0] = x * 255 / TEST_WIDTH;
+            pixel [1] = y * 255 / TEST_HEIGHT;
+            pixel [2] = ((x + y) * 2) + ((seed >> 16) & 31);
+        }
+    }
+
+    std::vector<uint8_t> lut (32768);
+    quantise_lut_build (test_palette, lut.data (), false);
+
+    for (uint32_t mode = 0; mode < DITHER_MODE_COUNT && result == 0; mode++)
+    {
+        Dither_Test reference;
+        reference.mode = (Dither_Mode) mode;
+        reference.groups = &row_groups [0];
+        reference.rgb = rgb.data ();
+        reference.lut = lut.data ();
+        dither_with (1, &reference);
+
+        for (const std::vector<uint32_t> &groups : row_groups)
+        {
+            for (uint32_t workers : worker_counts)
+            {
+                Dither_Test test = reference;
+                test.groups = &groups;
+                dither_with (workers, &test);
+
+                if (test.indexed != reference.indexed)
+                {
+                    fprintf (stderr, "%s: %u workers, rows in groups of %u...: indices differ from a single pass\n",
+                             dither_mode_names [mode], workers, groups [0]);
+                    result = -1;
+                }
+            }
+        }
+    }
+
+    if (result == 0)
+    {
+        printf ("dither_threads: ok\n");
+    }
+
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,209 @@
+/*
+ * Import thread-count test.
+ *
+ * Imports the same image with 1, 2, 3 and 8 worker threads, with each dither
+ * mode and with palette optimisation, checking that the palette, tile store
+ * and tile map are byte-identical whatever the number of workers.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include <vector>
+
+#include "dither.h"
+#include "jobs.h"
+#include "tile_store.h"
+#include "import.h"
+
+#define TEST_IMAGE          "import_threads.ppm"
+#define TEST_IMAGE_WIDTH    203     /* Neither dimension is a multiple of 8 */
+#define TEST_IMAGE_HEIGHT   141
+
+/* Compared against a single worker */
+static const uint32_t worker_counts [] = { 2, 3, 8 };
+
+static const uint8_t test_palette [16] = {
+    0x00, 0x3f, 0x15, 0x2a, 0x03, 0x0c, 0x30, 0x0f, 0x33, 0x3c, 0x01, 0x04, 0x10, 0x17, 0x2b, 0x3e
+};
+
+typedef struct Import_Result_s {
+    uint8_t palette [16];
+    std::vector<uint8_t> tiles;     /* Pixels then planar data of each tile in the store */
+    std::vector<uint32_t> map;
+    uint32_t map_width;
+    uint32_t map_height;
+} Import_Result;
+
+
+/*
+ * Write a test image: smooth gradients for the dithering to work on,
+ * with a repeating block pattern over part of it for deduplication.
+ */
+static bool image_write (const char *path)
+{
+    FILE *file = fopen (path, "wb");
+    uint32_t seed = 1;
+
+    if (file == NULL)
+    {
+        fprintf (stderr, "Unable to create %s.\n", path);
+        return false;
+    }
+
+    fprintf (file, "P6\n%u %u\n255\n", TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT);
+
+    for (uint32_t y = 0; y < TEST_IMAGE_HEIGHT; y++)
+    {
+        for (uint32_t x = 0; x < TEST_IMAGE_WIDTH; x++)
+        {
+            uint8_t rgb [3];
+
+            if (y < 48 && x < 96)
+            {
+                rgb [0] = ((x / 4) ^ (y / 4)) & 1 ? 255 : 0;
+                rgb [1] = (x % 8) * 32;
+                rgb [2] = (y % 8) * 32;
+            }
+            else
+            {
+                seed = seed * 1103515245 + 12345;
+                rgb [0] = x * 255 / TEST_IMAGE_WIDTH;
+                rgb [1] = y * 255 / TEST_IMAGE_HEIGHT;
+                rgb [2] = (x + y) + ((seed >> 16) & 15);
+            }
+
+            fwrite (rgb, 1, 3, file);
+        }
+    }
+
+    fclose (file);
+
+    return true;
+}
+
+
+/*
+ * Import the test image with the given number of workers.
+ */
+static bool import_with (uint32_t workers, Dither_Mode dither, bool optimise_palette, Import_Result *result)
+{
+    Import_Context *context = new Import_Context;
+    context->path = TEST_IMAGE;
+    context->optimise_palette = optimise_palette;
+    context->dither = dither;
+    context->transparent = false;
+    memcpy (context->palette, test_palette, sizeof (context->palette));
+
+    jobs_init (workers);
+    job_submit ("import", import_run, NULL, NULL, context);
+    while (jobs_active_count () > 0)
+    {
+        jobs_poll ();
+        usleep (1000);
+    }
+    jobs_shutdown ();
+
+    bool success = context->success;
+    if (!success)
+    {
+        fprintf (stderr, "Import with %u workers failed: %s\n", workers, context->error.c_str ());
+    }
+
+    memcpy (result->palette, context->palette, sizeof (result->palette));
+    result->tiles.clear ();
+    for (uint32_t i = 0; i < context->store.tiles.size (); i++)
+    {
+        const Tile &tile = context->store.tiles [i];
+        result->tiles.insert (result->tiles.end (), tile.pixel, tile.pixel + sizeof (tile.pixel));
+        result->tiles.insert (result->tiles.end (), tile.planar, tile.planar + sizeof (tile.planar));
+    }
+    result->map.assign (context->map.entry.begin (), context->map.entry.end ());
+    result->map_width = context->map.width;
+    result->map_height = context->map.height;
+
+    delete context;
+
+    return success;
+}
+
+
+/*
+ * Import with each worker count, comparing against a single worker.
+ * Returns -1 on the first difference.
+ */
+static int import_check (Dither_Mode dither, bool optimise_palette, const char *name)
+{
+    Import_Result reference;
+
+    if (!import_with (1, dither, optimise_palette, &reference))
+    {
+        return -1;
+    }
+
+    for (uint32_t workers : worker_counts)
+    {
+        Import_Result result;
+
+        if (!import_with (workers, dither, optimise_palette, &result))
+        {
+            return -1;
+        }
+
+        if (memcmp (result.palette, reference.palette, sizeof (reference.palette)) != 0)
+        {
+            fprintf (stderr, "%s: %u workers chose a different palette\n", name, workers);
+            return -1;
+        }
+        if (result.tiles != reference.tiles)
+        {
+            fprintf (stderr, "%s: %u workers made a different tile store (%u tiles, expected %u)\n", name, workers,
+                     (uint32_t) result.tiles.size () / 96, (uint32_t) reference.tiles.size () / 96);
+            return -1;
+        }
+        if (result.map_width != reference.map_width || result.map_height != reference.map_height ||
+            result.map != reference.map)
+        {
+            fprintf (stderr, "%s: %u workers made a different tile map\n", name, workers);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+int main (int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    int result = 0;
+
+    if (!image_write (TEST_IMAGE))
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t mode = 0; mode < DITHER_MODE_COUNT && result == 0; mode++)
+    {
+        result |= import_check ((Dither_Mode) mode, false, dither_mode_names [mode]);
+    }
+
+    if (result == 0)
+    {
+        result |= import_check (DITHER_FLOYD_STEINBERG, true, "optimised palette");
+    }
+
+    unlink (TEST_IMAGE);
+
+    if (result == 0)
+    {
+        printf ("import_threads: ok\n");
+    }
+
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
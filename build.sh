@@ -1,45 +1,59 @@
 #!/bin/sh
+#
+# Usage: ./build.sh [gcc|clang] [Release|Debug|RelWithDebInfo]
+#
+# Set LTO=1 to enable link-time optimisation.
+# Set UI_BENCHMARK=1 to count items in Snepsprite --benchmark-ui.
+# Each compiler and configuration has its own build directory under build/,
+# so switching between them does not force a full rebuild.
 
 # Select compiler
 COMPILER=${1:-"gcc"}
+CONFIG=${2:-"Release"}
 
 if [ ${COMPILER} = "clang" ]
 then
-    echo "Using GCC"
-    CC=gcc
-    CXX=g++
+    echo "Using Clang"
+    CC=clang
+    CXX=clang++
 else
     echo "Using GCC"
     CC=gcc
     CXX=g++
 fi
 
-# OS-specific compiler options
+if [ -n "${LTO}" ] && [ "${LTO}" != "0" ]
+then
+    LTO_OPTION=ON
+else
+    LTO_OPTION=OFF
+fi
+
+if [ -n "${UI_BENCHMARK}" ] && [ "${UI_BENCHMARK}" != "0" ]
+then
+    UI_BENCHMARK_OPTION=ON
+else
+    UI_BENCHMARK_OPTION=OFF
+fi
+
+# Parallel jobs
 if [ $(uname) = "Darwin" ]
 then
-    # MacOS
-    DATE=$(date "+%Y-%m-%d")
-    OS_FLAGS="-framework OpenGL -framework CoreFoundation"
+    JOBS=$(sysctl -n hw.ncpu)
 else
-    # Linux
-    DATE=$(date --rfc-3339=date)
-    OS_FLAGS="$(pkg-config --libs gl)"
+    JOBS=$(nproc)
 fi
 
-# Compile
-eval ${CXX} Source/main.cpp \
-    -DIMGUI_IMPL_OPENGL_LOADER_GL3W \
-    Libraries/imgui-1.76/*.cpp \
-    Libraries/imgui-1.76/examples/libs/gl3w/GL/gl3w.c \
-    Libraries/imgui-1.76/examples/imgui_impl_opengl3.cpp \
-    Libraries/imgui-1.76/examples/imgui_impl_sdl.cpp \
-    `sdl2-config --cflags` \
-    -I Source/ \
-    -I Libraries/imgui-1.76/ \
-    -I Libraries/imgui-1.76/examples/libs/gl3w/ \
-    `sdl2-config --libs` \
-    -ldl -DBUILD_DATE=\\\"$DATE\\\" \
-    ${OS_FLAGS} \
-    -o Snepsprite -std=c++11
+BUILD_DIR=build/${COMPILER}-${CONFIG}
+
+# Configure and compile
+cmake -S . -B ${BUILD_DIR} \
+    -DCMAKE_C_COMPILER=${CC} \
+    -DCMAKE_CXX_COMPILER=${CXX} \
+    -DCMAKE_BUILD_TYPE=${CONFIG} \
+    -DSNEPSPRITE_LTO=${LTO_OPTION} \
+    -DSNEPSPRITE_UI_BENCHMARK=${UI_BENCHMARK_OPTION} || exit 1
 
+cmake --build ${BUILD_DIR} -j ${JOBS} || exit 1
 
+cp ${BUILD_DIR}/Snepsprite Snepsprite